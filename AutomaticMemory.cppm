@@ -0,0 +1,150 @@
+/*
+    C++20 module interface for the library. `import AutomaticMemory;` gives the same names as
+    including MemManage.hpp, without parsing the header and its standard includes in every
+    translation unit. Only built with PASSIVEGC_BUILD_MODULE, see CMakeLists.txt.
+*/
+module;
+
+#include "MemManage.hpp"
+#include "AutomaticMemory/IoBuffers.hpp"
+
+export module AutomaticMemory;
+
+export namespace AutomaticMemory {
+    using AutomaticMemory::BasicHeap;
+    using AutomaticMemory::Heap;
+    using AutomaticMemory::TlsfHeap;
+    using AutomaticMemory::BuddyHeap;
+    using AutomaticMemory::SlabHeap;
+    using AutomaticMemory::ArenaHeap;
+    using AutomaticMemory::heap;
+
+    using AutomaticMemory::base_pointer;
+    using AutomaticMemory::SizeTypes;
+    using AutomaticMemory::Allocator;
+    using AutomaticMemory::HeapHandle;
+    using AutomaticMemory::HeapScope;
+    using AutomaticMemory::current_heap;
+    using AutomaticMemory::Placement;
+    using AutomaticMemory::placement_threshold;
+    using AutomaticMemory::place;
+    using AutomaticMemory::AllocationFlags;
+    using AutomaticMemory::has;
+    using AutomaticMemory::operator|;
+
+    using AutomaticMemory::basic_string;
+    using AutomaticMemory::basic_stringstream;
+    using AutomaticMemory::string;
+    using AutomaticMemory::wstring;
+    using AutomaticMemory::stringstream;
+    using AutomaticMemory::wstringstream;
+    using AutomaticMemory::vector;
+    using AutomaticMemory::list;
+
+    using AutomaticMemory::SizeClassParams;
+    using AutomaticMemory::SizeClass;
+    using AutomaticMemory::SizeClassTable;
+    using AutomaticMemory::DefaultSizeClasses;
+}
+
+export namespace AutomaticMemory::Errors {
+    using AutomaticMemory::Errors::base_error;
+    using AutomaticMemory::Errors::BadConstruct;
+    using AutomaticMemory::Errors::IndexOutOfBounds;
+    using AutomaticMemory::Errors::OutOfMemory;
+    using AutomaticMemory::Errors::InvalidFree;
+    using AutomaticMemory::Errors::IoError;
+}
+
+export namespace AutomaticMemory::Policies {
+    using AutomaticMemory::Policies::SingleThreaded;
+    using AutomaticMemory::Policies::Locked;
+    using AutomaticMemory::Policies::NoStats;
+    using AutomaticMemory::Policies::BasicStats;
+    using AutomaticMemory::Policies::BasicAccountedStats;
+    using AutomaticMemory::Policies::AccountedStats;
+    using AutomaticMemory::Policies::Timed;
+    using AutomaticMemory::Policies::ThrowOnError;
+    using AutomaticMemory::Policies::ExitOnError;
+    using AutomaticMemory::Policies::NullOnError;
+    using AutomaticMemory::Policies::SerialConstruction;
+    using AutomaticMemory::Policies::ParallelConstruction;
+}
+
+export namespace AutomaticMemory::Accounting {
+    using AutomaticMemory::Accounting::Kind;
+    using AutomaticMemory::Accounting::Key;
+    using AutomaticMemory::Accounting::type_name;
+    using AutomaticMemory::Accounting::type_key;
+    using AutomaticMemory::Accounting::tag;
+    using AutomaticMemory::Accounting::charge;
+    using AutomaticMemory::Accounting::credit;
+    using AutomaticMemory::Accounting::Entry;
+    using AutomaticMemory::Accounting::snapshot;
+}
+
+export namespace AutomaticMemory::Walk {
+    using AutomaticMemory::Walk::Sample;
+    using AutomaticMemory::Walk::capture;
+    using AutomaticMemory::Walk::Block;
+    using AutomaticMemory::Walk::Span;
+    using AutomaticMemory::Walk::write_header;
+    using AutomaticMemory::Walk::write_span;
+    using AutomaticMemory::Walk::DumpFile;
+    using AutomaticMemory::Walk::DumpedBlock;
+    using AutomaticMemory::Walk::DumpedSpan;
+    using AutomaticMemory::Walk::read_dump;
+}
+
+export namespace AutomaticMemory::Io {
+    using AutomaticMemory::Io::FixedBuffers;
+    using AutomaticMemory::Io::ReadOptions;
+    using AutomaticMemory::Io::MapOptions;
+    using AutomaticMemory::Io::File;
+    using AutomaticMemory::Io::open_for_read;
+    using AutomaticMemory::Io::read_fully;
+    using AutomaticMemory::Io::map_private;
+    using AutomaticMemory::Io::MappedFile;
+}
+
+export namespace AutomaticMemory::Pressure {
+    using AutomaticMemory::Pressure::cgroup_events;
+    using AutomaticMemory::Pressure::Monitor;
+}
+
+export namespace AutomaticMemory::Metrics {
+    using AutomaticMemory::Metrics::Histogram;
+    using AutomaticMemory::Metrics::Occupancy;
+    using AutomaticMemory::Metrics::HeapMetrics;
+    using AutomaticMemory::Metrics::render;
+    using AutomaticMemory::Metrics::write_file;
+    using AutomaticMemory::Metrics::write_socket;
+}
+
+export namespace AutomaticMemory::Backends {
+    using AutomaticMemory::Backends::Segments;
+    using AutomaticMemory::Backends::Tlsf;
+    using AutomaticMemory::Backends::Buddy;
+    using AutomaticMemory::Backends::BasicSlab;
+    using AutomaticMemory::Backends::Slab;
+    using AutomaticMemory::Backends::Arena;
+}
+
+export namespace AutomaticMemory::Os {
+    using AutomaticMemory::Os::page_size;
+    using AutomaticMemory::Os::round_to_pages;
+    using AutomaticMemory::Os::map;
+    using AutomaticMemory::Os::unmap;
+    using AutomaticMemory::Os::reserve;
+    using AutomaticMemory::Os::commit;
+    using AutomaticMemory::Os::decommit;
+    using AutomaticMemory::Os::Reservation;
+    using AutomaticMemory::Os::Pages;
+    using AutomaticMemory::Os::prefault;
+    using AutomaticMemory::Os::numa_nodes;
+    using AutomaticMemory::Os::interleave;
+    using AutomaticMemory::Os::first_touch;
+    using AutomaticMemory::Os::PrewarmPool;
+    using AutomaticMemory::Os::Counters;
+    using AutomaticMemory::Os::counters;
+}
@@ -0,0 +1,122 @@
+#include "Accounting.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace AutomaticMemory::Accounting {
+    namespace {
+        struct Totals {
+            Key key;
+            int64_t live_bytes = 0;
+            int64_t live_count = 0;
+            uint64_t allocations = 0;
+        };
+
+        /*
+            One thread's counters. The lock is only ever contended by snapshot(), so it's a couple of
+            uncontended atomic operations per allocation.
+        */
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<char const*, Totals> totals;
+            bool in_use = false;
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Shard>> shards;
+
+            Shard * acquire() {
+                std::lock_guard lock{mutex};
+                for (auto& shard : shards) {
+                    if (not shard->in_use) {
+                        shard->in_use = true;
+                        return shard.get();
+                    }
+                }
+                shards.push_back(std::make_unique<Shard>());
+                shards.back()->in_use = true;
+                return shards.back().get();
+            }
+
+            void release(Shard * shard) {
+                std::lock_guard lock{mutex};
+                shard->in_use = false;
+            }
+        };
+
+        // Never destroyed, threads may still charge while statics are torn down.
+        Registry& registry() {
+            static Registry * const instance = new Registry;
+            return *instance;
+        }
+
+        // Hands the shard back when its thread ends, the counts stay.
+        struct ThreadShard {
+            Shard * shard = registry().acquire();
+            ~ThreadShard() { registry().release(shard); }
+        };
+
+        Totals& totals_of(Shard& shard, Key key) {
+            auto [entry, inserted] = shard.totals.try_emplace(key.name.data());
+            if (inserted) {
+                entry->second.key = key;
+            }
+            return entry->second;
+        }
+
+        Shard& own_shard() {
+            thread_local ThreadShard own;
+            return *own.shard;
+        }
+    }
+
+    void charge(Key key, size_t size) {
+        Shard& shard = own_shard();
+        std::lock_guard lock{shard.mutex};
+        Totals& totals = totals_of(shard, key);
+        totals.live_bytes += static_cast<int64_t>(size);
+        ++totals.live_count;
+        ++totals.allocations;
+    }
+
+    void credit(Key key, size_t size, size_t count) {
+        Shard& shard = own_shard();
+        std::lock_guard lock{shard.mutex};
+        Totals& totals = totals_of(shard, key);
+        totals.live_bytes -= static_cast<int64_t>(size);
+        totals.live_count -= static_cast<int64_t>(count);
+    }
+
+    std::vector<Entry> snapshot() {
+        std::map<std::pair<Kind, std::string_view>, Entry> merged;
+        Registry& shards = registry();
+        std::lock_guard registry_lock{shards.mutex};
+        for (auto const& shard : shards.shards) {
+            std::lock_guard lock{shard->mutex};
+            for (auto const& [name, totals] : shard->totals) {
+                auto [entry, inserted] = merged.try_emplace({totals.key.kind, totals.key.name});
+                if (inserted) {
+                    entry->second.kind = totals.key.kind;
+                    entry->second.name = std::string{totals.key.name};
+                }
+                entry->second.live_bytes += totals.live_bytes;
+                entry->second.live_count += totals.live_count;
+                entry->second.allocations += totals.allocations;
+            }
+        }
+        std::vector<Entry> entries;
+        entries.reserve(merged.size());
+        for (auto& [key, entry] : merged) {
+            entries.push_back(std::move(entry));
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](Entry const& left, Entry const& right) {
+            return left.live_bytes > right.live_bytes;
+        });
+        return entries;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+    Live memory broken down by what it was allocated for: a type, for everything that goes through
+    allocate_constructed(_n) and Allocator<T_>, or a subsystem tag given to an Allocator.
+    Heaps only report here with Policies::AccountedStats, everything else costs nothing.
+
+    Every thread charges its own shard, so accounting never contends with other threads. snapshot()
+    merges the shards. A block freed on another thread than the one that allocated it makes both
+    shards' numbers odd, the merged ones are right. Shards of finished threads are kept and reused.
+*/
+namespace AutomaticMemory::Accounting {
+    enum class Kind : uint8_t {
+        Untagged,
+        Type,
+        Tag,
+    };
+
+    /*
+        What an allocation is charged to. `name` has to have static storage, string literals and
+        type_key() do. Keys are told apart by the address of their name, merged by its contents.
+    */
+    struct Key {
+        Kind kind = Kind::Untagged;
+        std::string_view name = "untagged";
+    };
+
+    // Compile time name of T_, as the compiler spells it.
+    template<typename T_>
+    constexpr std::string_view type_name() {
+        std::string_view const function = __PRETTY_FUNCTION__;
+        // GCC:   "... type_name() [with T_ = int; std::string_view = ...]"
+        // Clang: "... type_name() [T_ = int]"
+        // Array types have brackets of their own, e.g. "int [4]", so the end is the first ';' or unmatched ']'.
+        size_t const begin = function.find("T_ = ") + 5;
+        size_t end = begin;
+        for (size_t depth = 0; end < function.size(); ++end) {
+            char const c = function[end];
+            if (c == '[') {
+                ++depth;
+            } else if (c == ']' and depth > 0) {
+                --depth;
+            } else if (c == ';' or c == ']') {
+                break;
+            }
+        }
+        return function.substr(begin, end - begin);
+    }
+
+    template<typename T_>
+    constexpr Key type_key() {
+        return Key{Kind::Type, type_name<T_>()};
+    }
+
+    // E.g. Allocator<char>{Accounting::tag("parser")}.
+    constexpr Key tag(std::string_view name) {
+        return Key{Kind::Tag, name};
+    }
+
+    void charge(Key key, size_t size);
+    // `count` blocks of `size` bytes in total, e.g. everything a heap still had when it was reset.
+    void credit(Key key, size_t size, size_t count = 1);
+
+    struct Entry {
+        Kind kind;
+        std::string name;
+        // Signed, a shard can free more than it allocated. Merged they never go below zero.
+        int64_t live_bytes = 0;
+        int64_t live_count = 0;
+        uint64_t allocations = 0;
+    };
+
+    // Every key seen so far, merged over all threads, biggest live_bytes first.
+    std::vector<Entry> snapshot();
+}
@@ -0,0 +1,76 @@
+#include "ArenaBackend.hpp"
+
+#include <algorithm>
+
+namespace AutomaticMemory::Backends {
+    Arena::~Arena() {
+        for (auto chunk = m_Chunks.rbegin(); chunk != m_Chunks.rend(); ++chunk) {
+            m_Pages.unmap(chunk->memory, chunk->size);
+        }
+    }
+
+    bool Arena::owns(void * memory) const {
+        if (Os::Reservation const * reservation = m_Pages.reservation()) {
+            return reservation->committed_contains(memory);
+        }
+        auto const address = static_cast<unsigned char*>(memory);
+        for (Chunk const& chunk : m_Chunks) {
+            auto const begin = static_cast<unsigned char*>(chunk.memory);
+            if (address >= begin and address < begin + chunk.size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t Arena::reserved() const {
+        size_t total = 0;
+        for (Chunk const& chunk : m_Chunks) {
+            total += chunk.size;
+        }
+        return total;
+    }
+
+    bool Arena::snapshot(size_t part, std::vector<Walk::Span>& spans) const {
+        if (part >= m_Chunks.size()) {
+            return false;
+        }
+        Chunk const& chunk = m_Chunks[part];
+        auto * const begin = static_cast<unsigned char*>(chunk.memory);
+        bool const current = m_Cursor >= begin and m_Cursor <= begin + chunk.size;
+        size_t const used = current ? static_cast<size_t>(m_Cursor - begin) : chunk.size;
+        Walk::Span& span = spans.emplace_back(Walk::Span{chunk.memory, chunk.size, {}});
+        if (used > 0) {
+            span.blocks.push_back(Walk::Block{chunk.memory, used, {}});
+        }
+        return true;
+    }
+
+    void Arena::free_all() {
+        for (size_t i = m_Chunks.size(); i > 1; --i) {
+            m_Pages.unmap(m_Chunks[i - 1].memory, m_Chunks[i - 1].size);
+        }
+        if (m_Chunks.size() > 1) {
+            m_Chunks.erase(m_Chunks.begin() + 1, m_Chunks.end());
+        }
+        m_Cursor = m_End = nullptr;
+        if (not m_Chunks.empty()) {
+            m_Cursor = static_cast<unsigned char*>(m_Chunks.front().memory);
+            m_End = m_Cursor + m_Chunks.front().size;
+        }
+    }
+
+    size_t Arena::purge() {
+        if (m_Cursor == nullptr) {
+            return 0;
+        }
+        return Os::purge(m_Cursor, m_End - m_Cursor);
+    }
+
+    void Arena::add_chunk(size_t size) {
+        size_t const chunk_size = Os::round_to_pages(std::max(size, m_Options.chunk_size));
+        Chunk& chunk = m_Chunks.emplace_back(Chunk{m_Pages.map(chunk_size), chunk_size});
+        m_Cursor = static_cast<unsigned char*>(chunk.memory);
+        m_End = m_Cursor + chunk.size;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Os.hpp"
+#include "Walk.hpp"
+
+namespace AutomaticMemory::Backends {
+    /*
+        Bump pointer arena.
+        Allocation moves a cursor forward inside the current chunk and maps a new chunk
+        when it runs out. Individual frees do nothing, the memory comes back all at once
+        with free_all(). Meant for request or frame scoped memory that dies together.
+    */
+    class Arena {
+        public:
+        struct Options {
+            // Size of every chunk mapped from the OS. Bigger requests get a chunk of their own.
+            size_t chunk_size = size_t{1} << 20;
+            // If set, reserve this much contiguous address space up front and commit chunks out of it.
+            size_t reserve = 0;
+            // Fault every chunk in as it's mapped.
+            bool populate = false;
+            // Take chunks of exactly the chunk size from here, pre-faulted by a background thread.
+            // The pool has to outlive the backend.
+            Os::PrewarmPool * prewarm = nullptr;
+        };
+
+        constexpr Arena() : Arena(Options{}) {}
+        constexpr explicit Arena(Options options) : m_Options{options}, m_Pages{options.reserve, options.populate, options.prewarm} {}
+        Arena(Arena const&) = delete;
+        Arena& operator=(Arena const&) = delete;
+        ~Arena();
+
+        void * allocate(size_t size) {
+            size = (size + alignment - 1) & ~(alignment - 1);
+            if (m_Cursor == nullptr or size > static_cast<size_t>(m_End - m_Cursor)) {
+                add_chunk(size);
+            }
+            void * memory = m_Cursor;
+            m_Cursor += size;
+            return memory;
+        }
+
+        // Individual frees are a no-op, only free_all() gives memory back.
+        bool free(void *) {
+            return true;
+        }
+
+        bool owns(void * memory) const;
+
+        size_t reserved() const;
+
+        /*
+            Appends chunk number `part` to `spans`, for BasicHeap::walk(). An arena doesn't know where its
+            allocations start and end, so the used part of the chunk is reported as a single block. Chunks
+            before the current one count as used up to their end. Returns false once `part` is past the last one.
+        */
+        bool snapshot(size_t part, std::vector<Walk::Span>& spans) const;
+
+        /*
+            Releases every chunk but the first one, which is reused from its beginning.
+            Chunks go newest first, so a reservation gets its address space back as well.
+        */
+        void free_all();
+
+        // Gives the untouched rest of the current chunk back to the OS, see Os::purge(). Returns the bytes released.
+        size_t purge();
+
+        private:
+        static constexpr size_t alignment = 16;
+
+        struct Chunk {
+            void * memory;
+            size_t size;
+        };
+
+        void add_chunk(size_t size);
+
+        Options m_Options;
+        Os::Pages m_Pages;
+        std::vector<Chunk> m_Chunks;
+        unsigned char * m_Cursor = nullptr;
+        unsigned char * m_End = nullptr;
+    };
+}
@@ -0,0 +1,182 @@
+#include "BuddyBackend.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+namespace AutomaticMemory::Backends {
+    Buddy::Buddy(Options options)
+        : m_MinBlock{std::bit_ceil(std::max(options.min_block, Os::page_size()))},
+          m_MaxOrder{static_cast<size_t>(std::countr_zero(std::bit_ceil(std::max(options.max_block, m_MinBlock)) / m_MinBlock))},
+          m_Size{std::max<size_t>((options.region_size + block_size(m_MaxOrder) - 1) / block_size(m_MaxOrder), 1) * block_size(m_MaxOrder)},
+          m_Populate{options.populate},
+          m_Region{m_Size},
+          m_Base{static_cast<unsigned char*>(m_Region.base())} {
+        m_Orders.resize(m_Size / m_MinBlock, unallocated);
+        m_Free.resize(m_MaxOrder + 1);
+        m_Bitmaps.resize(m_MaxOrder + 1);
+        for (size_t order = 0; order <= m_MaxOrder; ++order) {
+            m_Bitmaps[order].resize((blocks_at(order) + 63) / 64);
+        }
+        free_all();
+    }
+
+    void * Buddy::allocate(size_t size) {
+        size_t const order = order_for(size);
+        if (order > m_MaxOrder) {
+            throw std::bad_alloc{};
+        }
+        size_t found = order;
+        while (found <= m_MaxOrder and m_Free[found] == nullptr) {
+            ++found;
+        }
+        if (found > m_MaxOrder) {
+            // Throws std::bad_alloc once the whole region is committed.
+            void * root = m_Region.commit(block_size(m_MaxOrder));
+            if (m_Populate) {
+                Os::prefault(root, block_size(m_MaxOrder));
+            }
+            insert_free(static_cast<FreeBlock*>(root), m_MaxOrder);
+            found = m_MaxOrder;
+        }
+        FreeBlock * block = m_Free[found];
+        remove_free(block, found);
+        // Split down to the requested order, the upper halves go to the free lists.
+        while (found > order) {
+            --found;
+            insert_free(reinterpret_cast<FreeBlock*>(reinterpret_cast<unsigned char*>(block) + block_size(found)), found);
+        }
+        m_Orders[offset_of(block) / m_MinBlock] = static_cast<uint8_t>(order);
+        return block;
+    }
+
+    bool Buddy::free(void * memory) {
+        if (not m_Region.contains(memory)) {
+            return false;
+        }
+        size_t const offset = offset_of(memory);
+        // Only the first slot of a live block has an order, interior pointers and freed blocks find none.
+        if (offset % m_MinBlock != 0 or offset >= m_Region.committed() or m_Orders[offset / m_MinBlock] == unallocated) {
+            return false;
+        }
+        release(offset, m_Orders[offset / m_MinBlock]);
+        return true;
+    }
+
+    bool Buddy::free_sized(void * memory, size_t size) {
+        size_t const order = order_for(size);
+#ifndef NDEBUG
+        if (not m_Region.contains(memory) or m_Orders[offset_of(memory) / m_MinBlock] != order) {
+            return false;
+        }
+#endif
+        release(offset_of(memory), order);
+        return true;
+    }
+
+    void Buddy::release(size_t offset, size_t order) {
+        m_Orders[offset / m_MinBlock] = unallocated;
+        while (order < m_MaxOrder) {
+            size_t const buddy = offset ^ block_size(order);
+            if (not is_free(buddy, order)) {
+                break;
+            }
+            remove_free(reinterpret_cast<FreeBlock*>(m_Base + buddy), order);
+            offset &= ~block_size(order);
+            ++order;
+        }
+        insert_free(reinterpret_cast<FreeBlock*>(m_Base + offset), order);
+    }
+
+    bool Buddy::snapshot(size_t part, std::vector<Walk::Span>& spans) const {
+        size_t const root = block_size(m_MaxOrder);
+        if ((part + 1) * root > m_Region.committed()) {
+            return false;
+        }
+        Walk::Span& span = spans.emplace_back(Walk::Span{m_Base + part * root, root, {}});
+        size_t offset = part * root;
+        while (offset < (part + 1) * root) {
+            // A free block is marked at its own order only, anything else starting here is allocated.
+            size_t order = m_MaxOrder + 1;
+            for (size_t candidate = m_MaxOrder + 1; candidate-- > 0;) {
+                if (offset % block_size(candidate) == 0 and is_free(offset, candidate)) {
+                    order = candidate;
+                    break;
+                }
+            }
+            if (order > m_MaxOrder) {
+                order = m_Orders[offset / m_MinBlock];
+                span.blocks.push_back(Walk::Block{m_Base + offset, block_size(order), {}});
+            }
+            offset += block_size(order);
+        }
+        return true;
+    }
+
+    void Buddy::free_all() {
+        for (size_t order = 0; order <= m_MaxOrder; ++order) {
+            m_Free[order] = nullptr;
+            std::fill(m_Bitmaps[order].begin(), m_Bitmaps[order].end(), 0);
+        }
+        std::fill(m_Orders.begin(), m_Orders.end(), unallocated);
+        size_t const root = block_size(m_MaxOrder);
+        while (m_Region.committed() > 0) {
+            m_Region.decommit(m_Base + m_Region.committed() - root, root);
+        }
+    }
+
+    size_t Buddy::purge() {
+        size_t released = 0;
+        for (size_t order = 0; order <= m_MaxOrder; ++order) {
+            if (block_size(order) <= Os::page_size()) {
+                continue;
+            }
+            for (FreeBlock * block = m_Free[order]; block != nullptr; block = block->next) {
+                released += Os::purge(block + 1, block_size(order) - sizeof(FreeBlock));
+            }
+        }
+        return released;
+    }
+
+    size_t Buddy::order_for(size_t size) const {
+        if (size <= m_MinBlock) {
+            return 0;
+        }
+        if (size > block_size(m_MaxOrder)) {
+            return m_MaxOrder + 1;
+        }
+        return std::bit_width((size - 1) / m_MinBlock);
+    }
+
+    void Buddy::set_free(size_t offset, size_t order, bool free) {
+        size_t const index = offset / block_size(order);
+        uint64_t const bit = uint64_t{1} << (index % 64);
+        if (free) {
+            m_Bitmaps[order][index / 64] |= bit;
+        } else {
+            m_Bitmaps[order][index / 64] &= ~bit;
+        }
+    }
+
+    void Buddy::insert_free(FreeBlock * block, size_t order) {
+        block->prev = nullptr;
+        block->next = m_Free[order];
+        if (block->next != nullptr) {
+            block->next->prev = block;
+        }
+        m_Free[order] = block;
+        set_free(offset_of(block), order, true);
+    }
+
+    void Buddy::remove_free(FreeBlock * block, size_t order) {
+        if (block->prev != nullptr) {
+            block->prev->next = block->next;
+        } else {
+            m_Free[order] = block->next;
+        }
+        if (block->next != nullptr) {
+            block->next->prev = block->prev;
+        }
+        set_free(offset_of(block), order, false);
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "Os.hpp"
+#include "Walk.hpp"
+
+namespace AutomaticMemory::Backends {
+    /*
+        Buddy system backend for power of two workloads.
+        One big region is reserved up front and cut into `max_block` sized roots. A block of
+        order k is `min_block << k` bytes and splits into two buddies of order k - 1, which
+        sit at offsets that differ only in bit (min_block << (k - 1)). That's why finding a
+        buddy is a xor and merging back is at most log2(max_block / min_block) steps.
+
+        Order:  2   [..............................................]   max_block
+                1   [.......................][.....................]
+                0   [..........][...........][..........][.........]   min_block
+
+        Every order has a bitmap of which blocks are free, so free() checks the buddy
+        without touching its memory, and an intrusive free list so allocate() pops a
+        block without scanning. Requests are rounded up to the next power of two, which
+        wastes nothing for the power of two sizes this backend is meant for.
+
+        The region is only reserved address space. Roots are committed one by one when the
+        free lists run dry, so a huge region costs nothing until it is actually used.
+    */
+    class Buddy {
+        public:
+        struct Options {
+            // Smallest block handed out, smaller requests are rounded up. Power of two, at least a page.
+            size_t min_block = size_t{4} << 10;
+            // Biggest block handed out. Power of two.
+            size_t max_block = size_t{64} << 20;
+            // Address space reserved at construction, rounded up to a multiple of max_block.
+            // Roots are committed on demand, so this can be far bigger than what is ever used.
+            size_t region_size = size_t{1} << 30;
+            // Fault every root in as it's committed, so allocations never page fault.
+            bool populate = false;
+        };
+
+        explicit Buddy(Options options);
+        Buddy(Buddy const&) = delete;
+        Buddy& operator=(Buddy const&) = delete;
+
+        void * allocate(size_t size);
+
+        // Every block starts on a page, so alignments up to a page are free. Larger ones throw std::bad_alloc.
+        void * allocate_aligned(size_t size, size_t alignment) {
+            if (alignment > Os::page_size()) {
+                throw std::bad_alloc{};
+            }
+            return allocate(size);
+        }
+
+        /*
+            Gives the block back and merges it with its buddy as long as the buddy is free too. Returns false,
+            touching nothing, for memory that isn't the start of a live block: outside the region, inside a
+            block, or freed already.
+        */
+        bool free(void * memory);
+
+        /*
+            free() for a block allocated with `size` bytes, aligned or not: the order comes from the size
+            instead of the order map. Debug builds (no NDEBUG) still check it against the map and return
+            false on a mismatch, like for memory that isn't ours.
+        */
+        bool free_sized(void * memory, size_t size);
+
+        bool owns(void * memory) const {
+            return m_Region.contains(memory);
+        }
+
+        size_t usable_size(void * memory) const {
+            return block_size(m_Orders[offset_of(memory) / m_MinBlock]);
+        }
+
+        size_t reserved() const {
+            return m_Region.committed();
+        }
+
+        /*
+            Appends the live blocks of committed root number `part` to `spans`, for BasicHeap::walk().
+            Returns false once `part` is past the last one.
+        */
+        bool snapshot(size_t part, std::vector<Walk::Span>& spans) const;
+
+        /*
+            Forgets every allocation and decommits every root, the region is back to untouched address space.
+        */
+        void free_all();
+
+        /*
+            Gives the pages inside free blocks back to the OS, see Os::purge(). Blocks smaller than a page
+            have nothing to give. Returns the bytes released.
+        */
+        size_t purge();
+
+        private:
+        // Links live in the first bytes of the free block itself.
+        struct FreeBlock {
+            FreeBlock * next;
+            FreeBlock * prev;
+        };
+
+        size_t block_size(size_t order) const { return m_MinBlock << order; }
+        size_t blocks_at(size_t order) const { return m_Size / block_size(order); }
+        size_t offset_of(void const * memory) const { return static_cast<unsigned char const*>(memory) - m_Base; }
+
+        size_t order_for(size_t size) const;
+
+        bool is_free(size_t offset, size_t order) const {
+            size_t const index = offset / block_size(order);
+            return m_Bitmaps[order][index / 64] >> (index % 64) & 1;
+        }
+
+        void set_free(size_t offset, size_t order, bool free);
+
+        void insert_free(FreeBlock * block, size_t order);
+
+        void remove_free(FreeBlock * block, size_t order);
+
+        void release(size_t offset, size_t order);
+
+        size_t m_MinBlock;
+        size_t m_MaxOrder;
+        size_t m_Size;
+        bool m_Populate;
+        Os::Reservation m_Region;
+        unsigned char * m_Base;
+        // Order of every allocated block, indexed by min_block sized slot of its first byte. Every other slot
+        // is `unallocated`.
+        static constexpr uint8_t unallocated = 0xff;
+        std::vector<uint8_t> m_Orders;
+        std::vector<FreeBlock*> m_Free;
+        std::vector<std::vector<uint64_t>> m_Bitmaps;
+    };
+}
@@ -0,0 +1,102 @@
+#include "Files.hpp"
+#include "Os.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AutomaticMemory::Io {
+    File::~File() {
+        if (m_Fd >= 0) {
+            ::close(m_Fd);
+        }
+    }
+
+    File open_for_read(std::string const& path, ReadOptions options, size_t& size) {
+        int fd = -1;
+        if (options.direct) {
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        }
+        if (fd < 0) {
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        File file{fd};
+        struct stat status;
+        if (not file or ::fstat(fd, &status) != 0) {
+            return {};
+        }
+        size = static_cast<size_t>(status.st_size);
+        return file;
+    }
+
+    ptrdiff_t read_fully(File const& file, void * buffer, size_t capacity, size_t size) {
+        auto * const bytes = static_cast<unsigned char*>(buffer);
+        size_t done = 0;
+        while (done < size) {
+            bool const direct = ::fcntl(file.fd(), F_GETFL) & O_DIRECT;
+            // Direct reads go on in whole blocks up to the capacity, the last one just comes back short.
+            size_t const wanted = direct ? capacity - done : size - done;
+            ssize_t const result = ::pread(file.fd(), bytes + done, wanted, static_cast<off_t>(done));
+            if (result < 0 and errno == EINTR) {
+                continue;
+            }
+            if (result < 0 and errno == EINVAL and direct) {
+                // Accepted at open, refused on read. Carry on through the page cache.
+                ::fcntl(file.fd(), F_SETFL, ::fcntl(file.fd(), F_GETFL) & ~O_DIRECT);
+                continue;
+            }
+            if (result < 0) {
+                return -1;
+            }
+            if (result == 0) {
+                // The file got shorter since it was opened.
+                break;
+            }
+            done += static_cast<size_t>(result);
+        }
+        return static_cast<ptrdiff_t>(done < size ? done : size);
+    }
+
+    void * map_private(File const& file, size_t size, MapOptions options) {
+        int const flags = MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0);
+        void * memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, file.fd(), 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        if (options.sequential) {
+            ::madvise(memory, size, MADV_SEQUENTIAL);
+        }
+        return memory;
+    }
+
+    MappedFile::MappedFile(std::string const& path, MapOptions options) {
+        File const file{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+        struct stat status;
+        if (not file or ::fstat(file.fd(), &status) != 0) {
+            return;
+        }
+        if (status.st_size == 0) {
+            errno = EINVAL;
+            return;
+        }
+        int const flags = MAP_SHARED | (options.populate ? MAP_POPULATE : 0);
+        void * memory = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, flags, file.fd(), 0);
+        if (memory == MAP_FAILED) {
+            return;
+        }
+        if (options.sequential) {
+            ::madvise(memory, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+        }
+        m_Memory = memory;
+        m_Size = static_cast<size_t>(status.st_size);
+    }
+
+    MappedFile::~MappedFile() {
+        if (m_Memory != nullptr) {
+            Os::unmap(m_Memory, Os::round_to_pages(m_Size));
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+
+/*
+    Loading files without the copies. BasicHeap::read_file() reads into an uninitialized, page aligned
+    heap buffer, optionally with O_DIRECT so the data doesn't pass through the page cache either.
+    BasicHeap::map_file() adopts a private file mapping as a heap block, and MappedFile is a plain
+    read-only mapping for data that is only ever read. The pieces here are what those are built on.
+*/
+namespace AutomaticMemory::Io {
+    struct ReadOptions {
+        // Read with O_DIRECT, bypassing the page cache. Falls back to buffered reads on file systems that refuse it.
+        bool direct = false;
+    };
+
+    struct MapOptions {
+        // Fault the whole file in right away (MAP_POPULATE) instead of page by page on first touch.
+        bool populate = false;
+        // Tell the kernel the mapping is read front to back, so it reads ahead aggressively.
+        bool sequential = true;
+    };
+
+    // An open file descriptor that closes itself.
+    class File {
+        public:
+        File() = default;
+        explicit File(int fd) : m_Fd{fd} {}
+        File(File&& other) noexcept : m_Fd{std::exchange(other.m_Fd, -1)} {}
+        File& operator=(File&& other) noexcept {
+            std::swap(m_Fd, other.m_Fd);
+            return *this;
+        }
+        File(File const&) = delete;
+        File& operator=(File const&) = delete;
+        ~File();
+
+        int fd() const { return m_Fd; }
+        explicit operator bool() const { return m_Fd >= 0; }
+
+        private:
+        int m_Fd = -1;
+    };
+
+    /*
+        Opens `path` for reading, with O_DIRECT if `options.direct` and the file system takes it. `size` is
+        set to the file's size. An empty File with errno set if it can't be opened.
+    */
+    File open_for_read(std::string const& path, ReadOptions options, size_t& size);
+
+    /*
+        Reads from the start of `file` into `buffer` until `size` bytes or the end of the file, short reads
+        are retried. An O_DIRECT read needs `buffer` and `capacity` aligned to the device's block size (a page
+        always is); `capacity` may exceed `size` for that. If the file system rejects O_DIRECT midway the rest
+        is read buffered. Returns the bytes read, or -1 with errno set.
+    */
+    ptrdiff_t read_fully(File const& file, void * buffer, size_t capacity, size_t size);
+
+    /*
+        Maps `size` bytes of `file` copy-on-write (MAP_PRIVATE, readable and writable): no copy is made until
+        a page is written, and writes never reach the file. nullptr with errno set on failure. Undo with Os::unmap().
+    */
+    void * map_private(File const& file, size_t size, MapOptions options);
+
+    /*
+        A read-only, shared mapping of a whole file. Pages come straight from the page cache, nothing is
+        copied or zeroed. Holds no file descriptor.
+    */
+    class MappedFile {
+        public:
+        MappedFile() = default;
+        // An empty MappedFile with errno set if the file can't be opened or mapped.
+        explicit MappedFile(std::string const& path, MapOptions options = {});
+        MappedFile(MappedFile&& other) noexcept
+            : m_Memory{std::exchange(other.m_Memory, nullptr)}, m_Size{std::exchange(other.m_Size, 0)} {}
+        MappedFile& operator=(MappedFile&& other) noexcept {
+            std::swap(m_Memory, other.m_Memory);
+            std::swap(m_Size, other.m_Size);
+            return *this;
+        }
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+        ~MappedFile();
+
+        unsigned char const * data() const { return static_cast<unsigned char const*>(m_Memory); }
+        size_t size() const { return m_Size; }
+        explicit operator bool() const { return m_Memory != nullptr; }
+
+        // The file as an array of T_, a partial element at the end is left out.
+        template<typename T_>
+        std::span<T_ const> as() const {
+            return {reinterpret_cast<T_ const*>(m_Memory), m_Size / sizeof(T_)};
+        }
+
+        private:
+        void * m_Memory = nullptr;
+        size_t m_Size = 0;
+    };
+}
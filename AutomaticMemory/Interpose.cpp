@@ -0,0 +1,153 @@
+#include "Interpose.hpp"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include <pthread.h>
+
+namespace AutomaticMemory {
+    namespace {
+        /*
+            Set while this thread is inside the heap. A nested call can only come from the runtime, e.g.
+            allocating the std::bad_alloc a backend throws under the heap's lock. It gets nullptr instead
+            of a deadlock, and the runtime falls back to its emergency pool.
+            Initial exec, so touching it never allocates, not even in the LD_PRELOAD library.
+        */
+        [[gnu::tls_model("initial-exec")]] thread_local bool t_InHeap = false;
+
+        class Reentry {
+            public:
+            Reentry() { t_InHeap = true; }
+            Reentry(Reentry const&) = delete;
+            Reentry& operator=(Reentry const&) = delete;
+            ~Reentry() { t_InHeap = false; }
+        };
+
+        // At namespace scope rather than in heap(): pthread_atfork() may allocate, and heap() isn't initialized yet then.
+        struct ForkHandlers {
+            ForkHandlers() {
+                ::pthread_atfork(&Interposer::before_fork, &Interposer::after_fork_in_parent, &Interposer::after_fork_in_child);
+            }
+        } const fork_handlers;
+    }
+
+    InterposeHeap& Interposer::heap() {
+        alignas(InterposeHeap) static unsigned char storage[sizeof(InterposeHeap)];
+        static InterposeHeap * heap = new (storage) InterposeHeap{};
+        return *heap;
+    }
+
+    void Interposer::before_fork() {
+        heap().m_Threading.lock();
+    }
+
+    void Interposer::after_fork_in_parent() {
+        heap().m_Threading.unlock();
+    }
+
+    void Interposer::after_fork_in_child() {
+        // Taken by the thread that forked, which is this one now. A fresh lock doesn't depend on that.
+        std::construct_at(&heap().m_Threading);
+    }
+
+    void * Interposer::allocate(size_t size) {
+        if (t_InHeap) {
+            return nullptr;
+        }
+        Reentry reentry;
+        return heap().allocate(size);
+    }
+
+    void * Interposer::allocate_aligned(size_t size, size_t alignment) {
+        if (t_InHeap) {
+            return nullptr;
+        }
+        Reentry reentry;
+        return heap().allocate_aligned(size, alignment);
+    }
+
+    void * Interposer::allocate_zeroed(size_t count, size_t size) {
+        size_t total;
+        if (__builtin_mul_overflow(count, size, &total)) {
+            return nullptr;
+        }
+        void * memory = allocate(total);
+        if (memory != nullptr) {
+            std::memset(memory, 0, total);
+        }
+        return memory;
+    }
+
+    void * Interposer::reallocate(void * memory, size_t size, void * (*foreign)(void *, size_t)) {
+        if (memory == nullptr) {
+            return allocate(size);
+        }
+        if (size == 0) {
+            free(memory);
+            return nullptr;
+        }
+        if (t_InHeap) {
+            return nullptr;
+        }
+        size_t const usable = usable_size(memory);
+        if (usable == 0) {
+            // Not ours, only its own allocator knows how much of it could be copied.
+            return foreign != nullptr ? foreign(memory, size) : nullptr;
+        }
+        if (size <= usable) {
+            return memory;
+        }
+        void * moved = allocate(size);
+        if (moved == nullptr) {
+            return nullptr;
+        }
+        std::memcpy(moved, memory, usable);
+        free(memory);
+        return moved;
+    }
+
+    void Interposer::free(void * memory) {
+        if (memory == nullptr or t_InHeap) {
+            return;
+        }
+        Reentry reentry;
+        // Stats are off for this heap, so the size doesn't matter. Foreign memory is ignored by NullOnError.
+        heap().free(memory, 0);
+    }
+
+    void Interposer::free_sized(void * memory, size_t size) {
+        if (memory == nullptr or t_InHeap) {
+            return;
+        }
+        Reentry reentry;
+        /*
+            Straight to the backend: BasicHeap::free_sized() hands a mismatch to NullOnError, which drops it,
+            and there'd be no telling a wrong size from foreign memory. Stats are off, there's nothing else
+            it would do.
+        */
+        InterposeHeap& interposed = heap();
+        std::lock_guard<Policies::Locked> lock{interposed.m_Threading};
+        if (not interposed.m_Backend.free_sized(memory, size)) {
+            interposed.m_Backend.free(memory);
+        }
+    }
+
+    size_t Interposer::usable_size(void * memory) {
+        if (memory == nullptr or t_InHeap) {
+            return 0;
+        }
+        Reentry reentry;
+        InterposeHeap& interposed = heap();
+        return interposed.owns(memory) ? interposed.usable_size(memory) : 0;
+    }
+
+    bool Interposer::owns(void * memory) {
+        if (memory == nullptr or t_InHeap) {
+            return false;
+        }
+        Reentry reentry;
+        return heap().owns(memory);
+    }
+}
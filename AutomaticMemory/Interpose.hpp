@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+
+#include "MemManage.hpp"
+
+namespace AutomaticMemory {
+    /*
+        Heap behind the malloc and operator new replacements.
+        Slab serves everything up to its largest class and TLSF everything above it. Neither keeps
+        bookkeeping anywhere but in memory it maps itself, so the heap never calls back into malloc
+        and the replacements can't recurse into themselves. One lock guards the whole heap.
+        Errors come back as nullptr, the callers turn them into errno or std::bad_alloc.
+    */
+    using InterposeHeap = BasicHeap<Backends::Slab, Policies::Locked, Policies::NoStats, Policies::NullOnError>;
+
+    /*
+        Malloc shaped entry points into InterposeHeap. NewDelete.cpp builds the global operator new
+        and delete on top of these, Preload.cpp exports them as the C allocation functions for LD_PRELOAD.
+
+        The heap is created on first use and never destroyed, frees can still come in from static
+        destructors and atexit handlers that run after everything else is gone. Memory the heap doesn't
+        own (e.g. allocated by the dynamic loader before the replacements took over) is never freed.
+    */
+    class Interposer {
+        public:
+        // nullptr when out of memory, like malloc.
+        static void * allocate(size_t size);
+        // `alignment` has to be a power of two.
+        static void * allocate_aligned(size_t size, size_t alignment);
+        // count * size zeroed bytes, nullptr on overflow.
+        static void * allocate_zeroed(size_t count, size_t size);
+        /*
+            Grows in place while the block is big enough, moves otherwise. Size zero frees and returns nullptr.
+            Memory that isn't ours, e.g. from before the replacements took over, goes to `foreign` (the next
+            realloc in the lookup order, for the preload library), there's no telling its size here. Without
+            one that's nullptr.
+        */
+        static void * reallocate(void * memory, size_t size, void * (*foreign)(void *, size_t) = nullptr);
+        static void free(void * memory);
+        /*
+            free() for a block allocate() or allocate_aligned() up to the default alignment gave out for
+            `size` bytes, what sized delete passes on. The slab puts it back under the class the size says,
+            without looking the class up. A size that doesn't match and memory that isn't ours go through
+            the unsized free instead, so a wrong size never leaks the block.
+        */
+        static void free_sized(void * memory, size_t size);
+        // Zero for nullptr and for memory that isn't ours.
+        static size_t usable_size(void * memory);
+        static bool owns(void * memory);
+
+        /*
+            fork() handlers, registered with pthread_atfork() when the library is loaded. The child only gets
+            the forking thread, so a heap lock some other thread held at that moment would never be released.
+            Before the fork the lock is taken, then released in the parent and made anew in the child.
+        */
+        static void before_fork();
+        static void after_fork_in_parent();
+        static void after_fork_in_child();
+
+        static InterposeHeap& heap();
+    };
+}
@@ -0,0 +1,115 @@
+#include "IoBuffers.hpp"
+#include "Os.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace AutomaticMemory::Io {
+    namespace {
+        // Buffer indices are 16 bits in an SQE, and the kernel stops at 16384 buffers per ring anyway.
+        constexpr size_t max_slices = size_t{1} << 14;
+
+        void prepare(io_uring_sqe& sqe, uint8_t opcode, int fd, void * buffer, uint64_t offset, size_t length, uint16_t index) {
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = fd;
+            sqe.off = offset;
+            sqe.addr = reinterpret_cast<uintptr_t>(buffer);
+            sqe.len = static_cast<uint32_t>(length);
+            sqe.buf_index = index;
+        }
+    }
+
+    bool FixedBuffers::Slice::read_fixed(io_uring_sqe& sqe, int fd, uint64_t offset, size_t length) const {
+        if (length > size()) {
+            return false;
+        }
+        prepare(sqe, IORING_OP_READ_FIXED, fd, data(), offset, length, m_Index);
+        return true;
+    }
+
+    bool FixedBuffers::Slice::write_fixed(io_uring_sqe& sqe, int fd, uint64_t offset, size_t length) const {
+        if (length > size()) {
+            return false;
+        }
+        prepare(sqe, IORING_OP_WRITE_FIXED, fd, data(), offset, length, m_Index);
+        return true;
+    }
+
+    FixedBuffers::FixedBuffers(Options options, HeapHandle heap)
+        : m_Heap{heap},
+          m_SliceSize{Os::round_to_pages(std::max<size_t>(options.slice_size, 1))},
+          m_Slices{std::clamp<size_t>(options.slices, 1, max_slices)} {
+        m_Base = static_cast<unsigned char*>(m_Heap.allocate_aligned(m_SliceSize * m_Slices, Os::page_size()));
+        if (m_Base == nullptr) {
+            throw std::bad_alloc{};
+        }
+        m_Free.reserve(m_Slices);
+        // Lowest index on top, so a lightly used pool keeps touching the same few slices.
+        for (size_t index = m_Slices; index-- > 0;) {
+            m_Free.push_back(static_cast<uint16_t>(index));
+        }
+    }
+
+    FixedBuffers::~FixedBuffers() {
+        unregister();
+        m_Heap.free(m_Base, m_SliceSize * m_Slices);
+    }
+
+    bool FixedBuffers::register_with(int ring) {
+        std::lock_guard lock{m_Mutex};
+        if (m_Ring >= 0) {
+            errno = EBUSY;
+            return false;
+        }
+        std::vector<iovec> buffers(m_Slices);
+        for (size_t index = 0; index < m_Slices; ++index) {
+            buffers[index] = iovec{m_Base + index * m_SliceSize, m_SliceSize};
+        }
+        if (::syscall(SYS_io_uring_register, ring, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(m_Slices)) != 0) {
+            return false;
+        }
+        m_Ring = ring;
+        return true;
+    }
+
+    void FixedBuffers::unregister() {
+        std::lock_guard lock{m_Mutex};
+        if (m_Ring >= 0) {
+            ::syscall(SYS_io_uring_register, m_Ring, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            m_Ring = -1;
+        }
+    }
+
+    bool FixedBuffers::registered() const {
+        std::lock_guard lock{m_Mutex};
+        return m_Ring >= 0;
+    }
+
+    FixedBuffers::Slice FixedBuffers::take() {
+        std::lock_guard lock{m_Mutex};
+        if (m_Free.empty()) {
+            return {};
+        }
+        uint16_t const index = m_Free.back();
+        m_Free.pop_back();
+        return Slice{this, index};
+    }
+
+    size_t FixedBuffers::available() const {
+        std::lock_guard lock{m_Mutex};
+        return m_Free.size();
+    }
+
+    void FixedBuffers::give_back(uint16_t index) {
+        std::lock_guard lock{m_Mutex};
+        m_Free.push_back(index);
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "MemManage.hpp"
+
+struct io_uring_sqe;
+
+namespace AutomaticMemory::Io {
+    /*
+        A pool of page aligned I/O buffers registered with an io_uring once, for IORING_OP_READ_FIXED and
+        IORING_OP_WRITE_FIXED. Registering pins the pages and maps them into the kernel a single time, so
+        fixed I/O skips the per request page pinning that plain reads and writes pay.
+
+        The region is one page aligned block of `heap`, allocated at construction and cut into `slices`
+        slices of `slice_size` bytes.
+        Every slice is its own registered buffer, its buffer index is its slice number. take() hands
+        slices out as Slice, which gives them back when it dies, like Heap::Pointer does with memory.
+        No liburing needed: registration is the raw io_uring_register() call, and Slice fills SQEs the
+        application got from its own ring.
+    */
+    class FixedBuffers {
+        public:
+        struct Options {
+            // Bytes per slice, rounded up to whole pages.
+            size_t slice_size = size_t{64} << 10;
+            // The kernel takes up to 16384 buffers per ring, more are clamped to that.
+            size_t slices = 256;
+        };
+
+        class Slice {
+            public:
+            Slice() = default;
+            Slice(Slice&& other) noexcept : m_Pool{std::exchange(other.m_Pool, nullptr)}, m_Index{other.m_Index} {}
+            Slice& operator=(Slice&& other) noexcept {
+                if (this != &other) {
+                    reset();
+                    m_Pool = std::exchange(other.m_Pool, nullptr);
+                    m_Index = other.m_Index;
+                }
+                return *this;
+            }
+            Slice(Slice const&) = delete;
+            Slice& operator=(Slice const&) = delete;
+            ~Slice() {
+                reset();
+            }
+
+            unsigned char * data() const { return m_Pool->m_Base + size_t{m_Index} * m_Pool->m_SliceSize; }
+            size_t size() const { return m_Pool->m_SliceSize; }
+            // The buffer index to put in io_uring_sqe::buf_index.
+            uint16_t index() const { return m_Index; }
+            explicit operator bool() const { return m_Pool != nullptr; }
+
+            /*
+                Fill `sqe` for a fixed read of `length` bytes at `offset` of `fd` into / a fixed write out of
+                the start of this slice. user_data and flags are left to the caller. Returns false and leaves
+                `sqe` alone if `length` is over size(), the kernel would go past the slice otherwise.
+            */
+            bool read_fixed(io_uring_sqe& sqe, int fd, uint64_t offset, size_t length) const;
+            bool write_fixed(io_uring_sqe& sqe, int fd, uint64_t offset, size_t length) const;
+
+            // Gives the slice back to its pool early.
+            void reset() {
+                if (m_Pool != nullptr) {
+                    std::exchange(m_Pool, nullptr)->give_back(m_Index);
+                }
+            }
+
+            private:
+            friend class FixedBuffers;
+            Slice(FixedBuffers * pool, uint16_t index) : m_Pool{pool}, m_Index{index} {}
+
+            FixedBuffers * m_Pool = nullptr;
+            uint16_t m_Index = 0;
+        };
+
+        // Throws std::bad_alloc if `heap` can't give a page aligned block that big.
+        explicit FixedBuffers(Options options, HeapHandle heap = {});
+        FixedBuffers() : FixedBuffers(Options{}) {}
+        FixedBuffers(FixedBuffers const&) = delete;
+        FixedBuffers& operator=(FixedBuffers const&) = delete;
+        // Unregisters if still registered and frees the region to its heap. Every Slice has to be gone by then.
+        ~FixedBuffers();
+
+        /*
+            Registers every slice with the ring behind `ring`, replacing buffers registered there before.
+            Returns false with errno set if the kernel refuses, e.g. without io_uring or over RLIMIT_MEMLOCK
+            on kernels before 5.12. One ring at a time, unregister() first to move to another one.
+        */
+        bool register_with(int ring);
+
+        // Drops the registration. Has to happen before the ring is closed, or not at all.
+        void unregister();
+
+        bool registered() const;
+
+        // A free slice, or an empty one when all of them are out. Safe to call from any thread.
+        Slice take();
+
+        size_t slice_size() const { return m_SliceSize; }
+        size_t slices() const { return m_Slices; }
+        size_t available() const;
+
+        private:
+        void give_back(uint16_t index);
+
+        HeapHandle m_Heap;
+        size_t m_SliceSize;
+        size_t m_Slices;
+        unsigned char * m_Base;
+        int m_Ring = -1;
+        std::vector<uint16_t> m_Free;
+        mutable std::mutex m_Mutex;
+    };
+}
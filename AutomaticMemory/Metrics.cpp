@@ -0,0 +1,184 @@
+#include "Metrics.hpp"
+#include "Os.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace AutomaticMemory::Metrics {
+    namespace {
+        void family(std::string& out, char const * name, char const * type, char const * help) {
+            out += "# TYPE ";
+            out += name;
+            out += ' ';
+            out += type;
+            out += "\n# HELP ";
+            out += name;
+            out += ' ';
+            out += help;
+            out += '\n';
+        }
+
+        // Label values escape backslashes, quotes and newlines.
+        std::string escaped(std::string_view value) {
+            std::string result;
+            for (char c : value) {
+                if (c == '\\' or c == '"') {
+                    result += '\\';
+                    result += c;
+                } else if (c == '\n') {
+                    result += "\\n";
+                } else {
+                    result += c;
+                }
+            }
+            return result;
+        }
+
+        void sample(std::string& out, std::string_view name, std::string_view labels, uint64_t value) {
+            out += name;
+            if (not labels.empty()) {
+                out += '{';
+                out += labels;
+                out += '}';
+            }
+            out += ' ';
+            out += std::to_string(value);
+            out += '\n';
+        }
+
+        std::string seconds(uint64_t ns) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(ns) / 1e9);
+            return buffer;
+        }
+
+        template<typename Get_>
+        void per_heap(std::string& out, std::span<HeapMetrics const> heaps, std::string_view name, Get_ const& get) {
+            for (HeapMetrics const& heap : heaps) {
+                if (auto const value = get(heap)) {
+                    sample(out, name, "heap=\"" + escaped(heap.name) + "\"", *value);
+                }
+            }
+        }
+
+        void size_classes(std::string& out, std::span<HeapMetrics const> heaps, char const * name, char const * help,
+                          size_t Occupancy::* member) {
+            family(out, name, "gauge", help);
+            for (HeapMetrics const& heap : heaps) {
+                for (Occupancy const& occupancy : heap.size_classes) {
+                    std::string const labels = "heap=\"" + escaped(heap.name) + "\",size=\"" + std::to_string(occupancy.size) + "\"";
+                    sample(out, name, labels, occupancy.*member);
+                }
+            }
+        }
+
+        void histogram(std::string& out, std::span<HeapMetrics const> heaps, char const * name, char const * help,
+                       std::optional<Histogram> HeapMetrics::* member) {
+            family(out, name, "histogram", help);
+            for (HeapMetrics const& heap : heaps) {
+                auto const& latency = heap.*member;
+                if (not latency) {
+                    continue;
+                }
+                std::string const label = "heap=\"" + escaped(heap.name) + "\"";
+                uint64_t cumulative = 0;
+                for (size_t bucket = 0; bucket + 1 < Histogram::buckets; ++bucket) {
+                    cumulative += latency->counts[bucket];
+                    sample(out, std::string{name} + "_bucket", label + ",le=\"" + seconds(Histogram::bound(bucket)) + "\"", cumulative);
+                }
+                sample(out, std::string{name} + "_bucket", label + ",le=\"+Inf\"", latency->count);
+                out += name;
+                out += "_sum{" + label + "} " + seconds(latency->sum_ns) + '\n';
+                sample(out, std::string{name} + "_count", label, latency->count);
+            }
+        }
+    }
+
+    std::string render(std::span<HeapMetrics const> heaps) {
+        std::string out;
+        using Value = std::optional<uint64_t>;
+
+        family(out, "passivegc_live_bytes", "gauge", "Bytes handed out and not freed yet.");
+        per_heap(out, heaps, "passivegc_live_bytes", [](HeapMetrics const& heap) { return Value{heap.live_bytes}; });
+        family(out, "passivegc_peak_bytes", "gauge", "Highest live_bytes seen so far.");
+        per_heap(out, heaps, "passivegc_peak_bytes", [](HeapMetrics const& heap) { return Value{heap.peak_bytes}; });
+        family(out, "passivegc_reserved_bytes", "gauge", "Bytes the backend holds from the OS.");
+        per_heap(out, heaps, "passivegc_reserved_bytes", [](HeapMetrics const& heap) {
+            return heap.reserved_bytes ? Value{*heap.reserved_bytes} : Value{};
+        });
+        family(out, "passivegc_allocations", "counter", "Allocations served.");
+        per_heap(out, heaps, "passivegc_allocations_total", [](HeapMetrics const& heap) { return Value{heap.allocations}; });
+        family(out, "passivegc_frees", "counter", "Blocks freed.");
+        per_heap(out, heaps, "passivegc_frees_total", [](HeapMetrics const& heap) { return Value{heap.frees}; });
+
+        size_classes(out, heaps, "passivegc_size_class_live_objects", "Live objects per size class.", &Occupancy::live);
+        size_classes(out, heaps, "passivegc_size_class_capacity_objects", "Objects the runs of a size class have room for.",
+                     &Occupancy::capacity);
+
+        histogram(out, heaps, "passivegc_allocate_latency_seconds", "Time spent in allocate, lock included.", &HeapMetrics::allocate_latency);
+        histogram(out, heaps, "passivegc_free_latency_seconds", "Time spent in free, lock included.", &HeapMetrics::free_latency);
+
+        Os::Counters const os = Os::counters();
+        family(out, "passivegc_os_maps", "counter", "Mappings and reservations made, all heaps.");
+        sample(out, "passivegc_os_maps_total", {}, os.maps);
+        family(out, "passivegc_os_unmaps", "counter", "Mappings given back, all heaps.");
+        sample(out, "passivegc_os_unmaps_total", {}, os.unmaps);
+        family(out, "passivegc_os_commits", "counter", "Reserved ranges committed, all heaps.");
+        sample(out, "passivegc_os_commits_total", {}, os.commits);
+        family(out, "passivegc_os_decommits", "counter", "Committed ranges decommitted, all heaps.");
+        sample(out, "passivegc_os_decommits_total", {}, os.decommits);
+        family(out, "passivegc_os_committed_bytes", "counter", "Bytes committed, all heaps.");
+        sample(out, "passivegc_os_committed_bytes_total", {}, os.committed_bytes);
+        family(out, "passivegc_os_decommitted_bytes", "counter", "Bytes decommitted, all heaps.");
+        sample(out, "passivegc_os_decommitted_bytes_total", {}, os.decommitted_bytes);
+
+        out += "# EOF\n";
+        return out;
+    }
+
+    bool write_file(std::string const& path, std::string_view text) {
+        std::string const temporary = path + ".tmp";
+        int const file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file < 0) {
+            return false;
+        }
+        size_t written = 0;
+        while (written < text.size()) {
+            ssize_t const result = ::write(file, text.data() + written, text.size() - written);
+            if (result < 0 and errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                ::close(file);
+                ::unlink(temporary.c_str());
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+        if (::close(file) != 0 or std::rename(temporary.c_str(), path.c_str()) != 0) {
+            ::unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool write_socket(int socket, std::string_view text) {
+        size_t written = 0;
+        while (written < text.size()) {
+            ssize_t const result = ::send(socket, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+            if (result < 0 and errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+    Heap statistics as OpenMetrics (Prometheus) text. BasicHeap::metrics() takes a snapshot of one heap
+    under its lock, render() turns snapshots of any number of heaps, plus the process wide OS counters,
+    into one exposition, and write_file() / write_socket() publish it. Nothing here walks the heap, a
+    snapshot is a handful of counters and one entry per size class, so scraping every second is fine.
+*/
+namespace AutomaticMemory::Metrics {
+    /*
+        Latency histogram with power of two buckets: bucket i counts durations up to 16 << i nanoseconds,
+        the last one everything longer. Not synchronized, heaps record into it under their lock.
+    */
+    struct Histogram {
+        static constexpr size_t buckets = 21;
+        static constexpr uint64_t first_bound = 16;
+
+        std::array<uint64_t, buckets> counts{};
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+
+        void record(uint64_t ns) {
+            size_t const bucket = ns == 0 ? 0 : static_cast<size_t>(std::bit_width((ns - 1) / first_bound));
+            ++counts[bucket < buckets ? bucket : buckets - 1];
+            ++count;
+            sum_ns += ns;
+        }
+
+        // Upper bound of bucket `bucket` in nanoseconds. The last bucket has none.
+        static constexpr uint64_t bound(size_t bucket) {
+            return first_bound << bucket;
+        }
+    };
+
+    // Of one size class: its object size, live objects and how many fit in its runs.
+    struct Occupancy {
+        size_t size;
+        size_t live;
+        size_t capacity;
+    };
+
+    // One heap at one point in time. Optional parts are missing when the heap's policies or backend can't tell.
+    struct HeapMetrics {
+        std::string name;
+        size_t live_bytes = 0;
+        size_t peak_bytes = 0;
+        std::optional<size_t> reserved_bytes;
+        uint64_t allocations = 0;
+        uint64_t frees = 0;
+        std::vector<Occupancy> size_classes;
+        std::optional<Histogram> allocate_latency;
+        std::optional<Histogram> free_latency;
+    };
+
+    // The whole exposition, `# EOF` included. Heaps are told apart by a heap="name" label.
+    std::string render(std::span<HeapMetrics const> heaps);
+
+    /*
+        Writes `text` to `path` atomically: to a temporary file next to it first, which is then renamed
+        over `path`, so a scraper reading the file never sees half an exposition.
+    */
+    bool write_file(std::string const& path, std::string_view text);
+
+    /*
+        Writes all of `text` to a connected socket, e.g. one accepted on a Unix socket the scraper
+        connects to. Retries short writes, never raises SIGPIPE. Returns false if the peer went away.
+    */
+    bool write_socket(int socket, std::string_view text);
+}
@@ -0,0 +1,124 @@
+/*
+    Replaces the global operator new and delete, every variant, with the interposed heap.
+    Link the PassiveGC::NewDelete object library into an executable and all of its C++ allocations,
+    standard containers included, come from AutomaticMemory without touching a single call site.
+*/
+#include "Interpose.hpp"
+
+#include <new>
+
+using AutomaticMemory::Interposer;
+
+namespace {
+    // What operator new promises: never nullptr, ask the new handler and retry, throw if there is none.
+    void * allocate_or_throw(std::size_t size, std::size_t alignment) {
+        if (size == 0) {
+            size = 1;
+        }
+        while (true) {
+            void * memory = Interposer::allocate_aligned(size, alignment);
+            if (memory != nullptr) {
+                return memory;
+            }
+            std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr) {
+                throw std::bad_alloc{};
+            }
+            handler();
+        }
+    }
+
+    void * allocate_or_null(std::size_t size, std::size_t alignment) noexcept {
+        try {
+            return allocate_or_throw(size, alignment);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+}
+
+void * operator new(std::size_t size) {
+    return allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new[](std::size_t size) {
+    return allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void * operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    return allocate_or_null(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    return allocate_or_null(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+    return allocate_or_null(size, static_cast<std::size_t>(alignment));
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+    return allocate_or_null(size, static_cast<std::size_t>(alignment));
+}
+
+/*
+    Sized deletes of default aligned blocks pass the size on, so the slab skips looking up the block's class.
+    Every other delete ends up in the same free, the backends find the size and alignment of a block from
+    its address. new with an alignment over the default may have picked a bigger class than the size says,
+    so the aligned sized variants don't use their size.
+*/
+void operator delete(void * memory) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete[](void * memory) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete(void * memory, std::size_t size) noexcept {
+    Interposer::free_sized(memory, size);
+}
+
+void operator delete[](void * memory, std::size_t size) noexcept {
+    Interposer::free_sized(memory, size);
+}
+
+void operator delete(void * memory, std::align_val_t) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete[](void * memory, std::align_val_t) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete(void * memory, std::size_t, std::align_val_t) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete[](void * memory, std::size_t, std::align_val_t) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete(void * memory, std::nothrow_t const&) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete[](void * memory, std::nothrow_t const&) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete(void * memory, std::align_val_t, std::nothrow_t const&) noexcept {
+    Interposer::free(memory);
+}
+
+void operator delete[](void * memory, std::align_val_t, std::nothrow_t const&) noexcept {
+    Interposer::free(memory);
+}
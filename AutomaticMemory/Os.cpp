@@ -0,0 +1,279 @@
+#include "Os.hpp"
+#include "Prewarm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace AutomaticMemory::Os {
+    namespace {
+        struct AtomicCounters {
+            std::atomic<uint64_t> maps{0};
+            std::atomic<uint64_t> unmaps{0};
+            std::atomic<uint64_t> commits{0};
+            std::atomic<uint64_t> decommits{0};
+            std::atomic<uint64_t> committed_bytes{0};
+            std::atomic<uint64_t> decommitted_bytes{0};
+        };
+
+        constinit AtomicCounters s_Counters;
+
+        void count(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+            counter.fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+
+    Counters counters() {
+        return Counters{
+            s_Counters.maps.load(std::memory_order_relaxed),
+            s_Counters.unmaps.load(std::memory_order_relaxed),
+            s_Counters.commits.load(std::memory_order_relaxed),
+            s_Counters.decommits.load(std::memory_order_relaxed),
+            s_Counters.committed_bytes.load(std::memory_order_relaxed),
+            s_Counters.decommitted_bytes.load(std::memory_order_relaxed),
+        };
+    }
+
+    size_t page_size() {
+        static size_t const size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    void * map(size_t size, bool populate) {
+        int const flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
+        void * memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc{};
+        }
+        count(s_Counters.maps);
+        return memory;
+    }
+
+    void unmap(void * memory, size_t size) {
+        ::munmap(memory, size);
+        count(s_Counters.unmaps);
+    }
+
+    void * reserve(size_t size) {
+        void * memory = ::mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc{};
+        }
+        count(s_Counters.maps);
+        return memory;
+    }
+
+    void commit(void * memory, size_t size) {
+        if (::mprotect(memory, size, PROT_READ | PROT_WRITE) != 0) {
+            throw std::bad_alloc{};
+        }
+        count(s_Counters.commits);
+        count(s_Counters.committed_bytes, size);
+    }
+
+    void decommit(void * memory, size_t size) {
+        ::madvise(memory, size, MADV_DONTNEED);
+        ::mprotect(memory, size, PROT_NONE);
+        count(s_Counters.decommits);
+        count(s_Counters.decommitted_bytes, size);
+    }
+
+    namespace {
+        // Parses a sysfs list like "0-3,8,10-11".
+        std::vector<size_t> read_list(char const * path) {
+            std::vector<size_t> values;
+            std::ifstream file{path};
+            std::string list;
+            if (not std::getline(file, list)) {
+                return values;
+            }
+            size_t position = 0;
+            while (position < list.size()) {
+                size_t const comma = std::min(list.find(',', position), list.size());
+                std::string const range = list.substr(position, comma - position);
+                size_t const dash = range.find('-');
+                size_t const first = std::stoul(range);
+                size_t const last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (size_t value = first; value <= last; ++value) {
+                    values.push_back(value);
+                }
+                position = comma + 1;
+            }
+            return values;
+        }
+
+        std::vector<size_t> const& online_nodes() {
+            static std::vector<size_t> const nodes = [] {
+                std::vector<size_t> nodes = read_list("/sys/devices/system/node/online");
+                return nodes.empty() ? std::vector<size_t>{0} : nodes;
+            }();
+            return nodes;
+        }
+
+        // Whole pages inside [memory, memory + size), as [begin, end). Empty if there are none.
+        std::pair<unsigned char*, unsigned char*> whole_pages(void * memory, size_t size) {
+            auto const page = page_size();
+            auto const begin = (reinterpret_cast<uintptr_t>(memory) + page - 1) & ~(page - 1);
+            auto const end = (reinterpret_cast<uintptr_t>(memory) + size) & ~(page - 1);
+            if (end <= begin) {
+                return {nullptr, nullptr};
+            }
+            return {reinterpret_cast<unsigned char*>(begin), reinterpret_cast<unsigned char*>(end)};
+        }
+    }
+
+    size_t purge(void * memory, size_t size) {
+        auto const [begin, end] = whole_pages(memory, size);
+        if (begin == nullptr or ::madvise(begin, end - begin, MADV_DONTNEED) != 0) {
+            return 0;
+        }
+        count(s_Counters.decommits);
+        count(s_Counters.decommitted_bytes, end - begin);
+        return end - begin;
+    }
+
+    void prefault(void * memory, size_t size) {
+        // Older headers don't know it yet, the value is fixed by the kernel's ABI.
+#ifndef MADV_POPULATE_WRITE
+        constexpr int MADV_POPULATE_WRITE = 23;
+#endif
+        static std::atomic<bool> populate_write{true};
+        auto const [begin, end] = whole_pages(memory, size);
+        if (begin == nullptr) {
+            return;
+        }
+        if (populate_write.load(std::memory_order_relaxed)) {
+            if (::madvise(begin, end - begin, MADV_POPULATE_WRITE) == 0) {
+                return;
+            }
+            if (errno == EINVAL) {
+                // Kernel before 5.14, don't ask again.
+                populate_write.store(false, std::memory_order_relaxed);
+            }
+        }
+        // The pages are the caller's, so writing back what was read is safe.
+        for (volatile unsigned char * at = begin; at < end; at += page_size()) {
+            *at = *at;
+        }
+    }
+
+    size_t numa_nodes() {
+        return online_nodes().size();
+    }
+
+    bool interleave(void * memory, size_t size) {
+        auto const [begin, end] = whole_pages(memory, size);
+        if (begin == nullptr) {
+            return true;
+        }
+        constexpr size_t bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(online_nodes().back() / bits + 1, 0);
+        for (size_t node : online_nodes()) {
+            mask[node / bits] |= 1ul << (node % bits);
+        }
+        return ::syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE, mask.data(), mask.size() * bits + 1, MPOL_MF_MOVE) == 0;
+    }
+
+    void first_touch(void * memory, size_t size) {
+        auto const [begin, end] = whole_pages(memory, size);
+        if (begin == nullptr) {
+            return;
+        }
+        std::vector<size_t> const& nodes = online_nodes();
+        size_t const page = page_size();
+        size_t const pages = (end - begin) / page;
+        auto const touch = [page](unsigned char * from, unsigned char * to) {
+            for (volatile unsigned char * at = from; at < to; at += page) {
+                *at = 0;
+            }
+        };
+        if (nodes.size() == 1) {
+            touch(begin, end);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            unsigned char * const from = begin + pages * i / nodes.size() * page;
+            unsigned char * const to = begin + pages * (i + 1) / nodes.size() * page;
+            workers.emplace_back([node = nodes[i], from, to, &touch] {
+                std::string const path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                for (size_t cpu : read_list(path.c_str())) {
+                    CPU_SET(cpu, &cpus);
+                }
+                // If pinning fails the pages still get touched, just not necessarily on this node.
+                ::sched_setaffinity(0, sizeof(cpus), &cpus);
+                touch(from, to);
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    Reservation::Reservation(size_t size) : m_Size{round_to_pages(size)} {
+        m_Base = static_cast<unsigned char*>(reserve(m_Size));
+    }
+
+    Reservation::~Reservation() {
+        unmap(m_Base, m_Size);
+    }
+
+    void * Reservation::commit(size_t size) {
+        size = round_to_pages(size);
+        if (size > m_Size - m_Committed) {
+            throw std::bad_alloc{};
+        }
+        void * memory = m_Base + m_Committed;
+        Os::commit(memory, size);
+        m_Committed += size;
+        return memory;
+    }
+
+    void Reservation::decommit(void * memory, size_t size) {
+        size = round_to_pages(size);
+        Os::decommit(memory, size);
+        if (static_cast<unsigned char*>(memory) + size == m_Base + m_Committed) {
+            m_Committed -= size;
+        }
+    }
+
+    void * Pages::map(size_t size) {
+        if (m_ReserveSize == 0) {
+            if (m_Prewarm != nullptr and size == m_Prewarm->span_size()) {
+                return m_Prewarm->take();
+            }
+            return Os::map(size, m_Populate);
+        }
+        if (not m_Reservation) {
+            m_Reservation.emplace(m_ReserveSize);
+        }
+        void * memory = m_Reservation->commit(size);
+        if (m_Populate) {
+            prefault(memory, size);
+        }
+        return memory;
+    }
+
+    void Pages::unmap(void * memory, size_t size) {
+        if (m_Reservation) {
+            m_Reservation->decommit(memory, size);
+        } else if (m_Prewarm != nullptr and size == m_Prewarm->span_size()) {
+            m_Prewarm->give_back(memory);
+        } else {
+            Os::unmap(memory, size);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/*
+    Thin layer over the operating system's virtual memory calls.
+    Backends that manage their own pools take their memory from here instead of
+    operator new, so the pools are page aligned and can be handed back to the OS
+    as a whole. Definitions live in Os.cpp, so nothing but that file sees the
+    platform headers.
+*/
+namespace AutomaticMemory::Os {
+    size_t page_size();
+
+    inline size_t round_to_pages(size_t size) {
+        size_t const page = page_size();
+        return (size + page - 1) & ~(page - 1);
+    }
+
+    /*
+        Maps `size` bytes of zeroed, readable and writable memory. `size` should already be
+        rounded to pages. Throws std::bad_alloc when the OS refuses, same as operator new would.
+        With `populate` every page is faulted in right away (MAP_POPULATE), so the first touch is free.
+    */
+    void * map(size_t size, bool populate = false);
+
+    void unmap(void * memory, size_t size);
+
+    /*
+        Reserves `size` bytes of address space without backing it. Nothing can be touched
+        until it is committed, and the OS doesn't account any of it against the process.
+    */
+    void * reserve(size_t size);
+
+    // Makes reserved pages usable. They are backed lazily, on first touch.
+    void commit(void * memory, size_t size);
+
+    // Drops the pages' contents and makes them inaccessible again. The address space stays reserved.
+    void decommit(void * memory, size_t size);
+
+    /*
+        Gives the physical memory behind the whole pages inside [memory, memory + size) back to the OS
+        (MADV_DONTNEED). Unlike decommit() the pages stay accessible and read back as zeros, so it works
+        on free memory in the middle of a pool. Counted as a decommit. Returns the bytes released.
+    */
+    size_t purge(void * memory, size_t size);
+
+    /*
+        Faults in the whole pages inside [memory, memory + size) without changing their contents,
+        with MADV_POPULATE_WRITE where the kernel has it (5.14+), by touching every page otherwise.
+    */
+    void prefault(void * memory, size_t size);
+
+    /*
+        Calls into the OS since the process started, for metrics. Reservations count as maps. Relaxed
+        atomics, so the numbers of one snapshot may be a call or two apart from each other.
+    */
+    struct Counters {
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t commits;
+        uint64_t decommits;
+        uint64_t committed_bytes;
+        uint64_t decommitted_bytes;
+    };
+
+    Counters counters();
+
+    // Online NUMA nodes, 1 on machines (or kernels) without NUMA.
+    size_t numa_nodes();
+
+    /*
+        Interleaves the whole pages inside [memory, memory + size) round robin over every online node.
+        Pages that were touched already are migrated. Partial pages at the ends are left alone, they
+        belong to the neighbours as well. Returns false if the kernel refuses, e.g. without NUMA support.
+    */
+    bool interleave(void * memory, size_t size);
+
+    /*
+        Splits the whole pages inside [memory, memory + size) in one slice per node and touches every
+        slice from a thread running on that node, so the OS backs each slice with that node's memory.
+        Only works on pages nobody touched yet. Touching writes a zero to the first byte of every page.
+    */
+    void first_touch(void * memory, size_t size);
+
+    /*
+        One contiguous reserved range that is committed from the bottom up.
+        Since everything handed out lives in [base, base + size), ownership is a range compare
+        and, in reservations up to max_compressible (64 GiB at 16 bytes), any address in it fits a
+        32 bit offset in `granularity` units.
+    */
+    class Reservation {
+        public:
+        static constexpr size_t granularity = 16;
+        static constexpr size_t max_compressible = (size_t{1} << 32) * granularity;
+
+        explicit Reservation(size_t size);
+        Reservation(Reservation const&) = delete;
+        Reservation& operator=(Reservation const&) = delete;
+        ~Reservation();
+
+        /*
+            Commits the next `size` bytes (rounded to pages) above everything committed so far.
+            Throws std::bad_alloc when the reservation is used up.
+        */
+        void * commit(size_t size);
+
+        /*
+            Decommits a committed range. If it is the topmost one, the address space is given back
+            too and the next commit reuses it.
+        */
+        void decommit(void * memory, size_t size);
+
+        bool contains(void const * memory) const {
+            auto const address = static_cast<unsigned char const*>(memory);
+            return address >= m_Base and address < m_Base + m_Size;
+        }
+
+        // Only the committed part, the reserved rest above it faults when touched.
+        bool committed_contains(void const * memory) const {
+            auto const address = static_cast<unsigned char const*>(memory);
+            return address >= m_Base and address < m_Base + m_Committed;
+        }
+
+        // Whether compress() can describe every address of this reservation.
+        bool compressible() const { return m_Size <= max_compressible; }
+
+        // Only for compressible() reservations, offsets would wrap in bigger ones.
+        uint32_t compress(void const * memory) const {
+            assert(compressible() and contains(memory));
+            return static_cast<uint32_t>((static_cast<unsigned char const*>(memory) - m_Base) / granularity);
+        }
+
+        void * decompress(uint32_t offset) const {
+            return m_Base + size_t{offset} * granularity;
+        }
+
+        void * base() const { return m_Base; }
+        size_t size() const { return m_Size; }
+        size_t committed() const { return m_Committed; }
+
+        private:
+        unsigned char * m_Base;
+        size_t m_Size;
+        size_t m_Committed = 0;
+    };
+
+    class PrewarmPool;
+
+    /*
+        Where backends get their pools and chunks from. By default every request is its own mapping.
+        Given a reservation size, requests are committed back to back out of one reserved range instead.
+        The range is reserved by the first map(), so constructing Pages is free.
+        With `populate` everything is faulted in as it's mapped. Given a PrewarmPool, requests of exactly
+        its span size are taken from the pool instead (unless there's a reservation) and handed back to it.
+    */
+    class Pages {
+        public:
+        constexpr explicit Pages(size_t reserve = 0, bool populate = false, PrewarmPool * prewarm = nullptr)
+            : m_ReserveSize{reserve}, m_Populate{populate}, m_Prewarm{prewarm} {}
+        Pages(Pages const&) = delete;
+        Pages& operator=(Pages const&) = delete;
+
+        void * map(size_t size);
+        void unmap(void * memory, size_t size);
+
+        // Null unless the pages come out of a reservation and something was mapped already.
+        Reservation const * reservation() const {
+            return m_Reservation ? &*m_Reservation : nullptr;
+        }
+
+        private:
+        size_t m_ReserveSize;
+        bool m_Populate;
+        PrewarmPool * m_Prewarm;
+        std::optional<Reservation> m_Reservation;
+    };
+}
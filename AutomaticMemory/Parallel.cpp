@@ -0,0 +1,11 @@
+#include "Parallel.hpp"
+
+namespace AutomaticMemory::Parallel {
+    size_t hardware_threads() {
+        static size_t const threads = [] {
+            unsigned const hardware = std::thread::hardware_concurrency();
+            return hardware == 0 ? size_t{1} : size_t{hardware};
+        }();
+        return threads;
+    }
+}
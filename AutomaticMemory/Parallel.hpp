@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*
+    Just enough fork/join for splitting one big loop across the machine. Threads are started
+    per call, which is nothing next to the arrays worth splitting.
+*/
+namespace AutomaticMemory::Parallel {
+    // Threads worth using, hardware_concurrency() or 1 when it is unknown.
+    size_t hardware_threads();
+
+    /*
+        Splits [0, count) into `chunks` contiguous ranges and runs function(chunk, begin, end) for
+        each, the first one on the calling thread. Returns when all of them are done.
+        `function` must not throw, exceptions have to be caught and reported inside it.
+        Doesn't throw either, so it's safe in destructors: chunks that can't get a thread, because the
+        process ran out of threads or memory for them, run on the calling thread instead.
+    */
+    template<typename Function_>
+    void for_chunks(size_t count, size_t chunks, Function_ const& function) {
+        if (chunks <= 1) {
+            function(size_t{0}, size_t{0}, count);
+            return;
+        }
+        auto const begin_of = [&](size_t chunk) { return count / chunks * chunk + (chunk < count % chunks ? chunk : count % chunks); };
+        std::vector<std::thread> workers;
+        size_t started = 1;
+        try {
+            // Reserved up front, so emplace_back never reallocates and only the thread itself can fail.
+            workers.reserve(chunks - 1);
+            for (; started < chunks; ++started) {
+                workers.emplace_back([&function, chunk = started, begin = begin_of(started), end = begin_of(started + 1)] {
+                    function(chunk, begin, end);
+                });
+            }
+        } catch (...) {
+            // std::system_error or std::bad_alloc, whatever started keeps running and is joined below.
+        }
+        function(size_t{0}, size_t{0}, begin_of(1));
+        for (size_t chunk = started; chunk < chunks; ++chunk) {
+            function(chunk, begin_of(chunk), begin_of(chunk + 1));
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+}
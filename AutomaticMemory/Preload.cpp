@@ -0,0 +1,97 @@
+/*
+    The C allocation functions on top of the interposed heap, built as libpassivegc_malloc.so.
+
+        LD_PRELOAD=./libpassivegc_malloc.so ./program
+
+    runs an unmodified program with every malloc, and so every operator new of libstdc++, served by
+    AutomaticMemory. Besides what's asked for usually, aligned_alloc, memalign and valloc are exported
+    too, otherwise glibc would hand out blocks that end up in our free.
+
+    Blocks from before the preload took over, or from an allocator found with dlsym, aren't ours. realloc
+    hands them to the next realloc (glibc's), free ignores them.
+
+    fork() from a threaded program is safe, Interposer registers fork handlers for the heap's lock as soon
+    as this library is loaded.
+*/
+#include "Interpose.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <malloc.h>
+
+using AutomaticMemory::Interposer;
+
+namespace {
+    bool is_power_of_two(size_t value) {
+        return value != 0 and (value & (value - 1)) == 0;
+    }
+
+    void * out_of_memory_if_null(void * memory) {
+        if (memory == nullptr) {
+            errno = ENOMEM;
+        }
+        return memory;
+    }
+
+    // The realloc this library hides. Only looked up once a foreign block shows up, dlsym may allocate.
+    void * next_realloc(void * memory, size_t size) {
+        using Realloc = void * (*)(void *, size_t);
+        static Realloc const next = reinterpret_cast<Realloc>(::dlsym(RTLD_NEXT, "realloc"));
+        return next != nullptr ? next(memory, size) : nullptr;
+    }
+}
+
+extern "C" {
+    void * malloc(size_t size) noexcept {
+        return out_of_memory_if_null(Interposer::allocate(size));
+    }
+
+    void free(void * memory) noexcept {
+        Interposer::free(memory);
+    }
+
+    void * calloc(size_t count, size_t size) noexcept {
+        return out_of_memory_if_null(Interposer::allocate_zeroed(count, size));
+    }
+
+    void * realloc(void * memory, size_t size) noexcept {
+        if (memory != nullptr and size == 0) {
+            Interposer::free(memory);
+            return nullptr;
+        }
+        return out_of_memory_if_null(Interposer::reallocate(memory, size, next_realloc));
+    }
+
+    int posix_memalign(void ** result, size_t alignment, size_t size) noexcept {
+        if (not is_power_of_two(alignment) or alignment % sizeof(void*) != 0) {
+            return EINVAL;
+        }
+        void * memory = Interposer::allocate_aligned(size, alignment);
+        if (memory == nullptr) {
+            return ENOMEM;
+        }
+        *result = memory;
+        return 0;
+    }
+
+    void * aligned_alloc(size_t alignment, size_t size) noexcept {
+        if (not is_power_of_two(alignment)) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return out_of_memory_if_null(Interposer::allocate_aligned(size, alignment));
+    }
+
+    void * memalign(size_t alignment, size_t size) noexcept {
+        return aligned_alloc(alignment, size);
+    }
+
+    void * valloc(size_t size) noexcept {
+        return out_of_memory_if_null(Interposer::allocate_aligned(size, AutomaticMemory::Os::page_size()));
+    }
+
+    size_t malloc_usable_size(void * memory) noexcept {
+        return Interposer::usable_size(memory);
+    }
+}
@@ -0,0 +1,153 @@
+#include "Pressure.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace AutomaticMemory::Pressure {
+    std::string cgroup_events() {
+        std::ifstream cgroups{"/proc/self/cgroup"};
+        std::string line;
+        while (std::getline(cgroups, line)) {
+            // The unified hierarchy is the "0::/path" line, v1 controllers have their own numbers.
+            if (line.rfind("0::", 0) != 0) {
+                continue;
+            }
+            std::string const group = line.substr(3);
+            for (char const * mount : {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"}) {
+                std::string const path = std::string{mount} + (group == "/" ? "" : group) + "/memory.events";
+                if (std::ifstream{path}.is_open()) {
+                    return path;
+                }
+            }
+        }
+        return {};
+    }
+
+    Monitor::Monitor(Options options) : m_Options{std::move(options)} {
+        if (not m_Options.psi.empty()) {
+            m_Psi = ::open(m_Options.psi.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (m_Psi >= 0) {
+                std::string const trigger = "some " + std::to_string(m_Options.stall.count()) + " " + std::to_string(m_Options.window.count());
+                // The kernel wants the terminating zero as part of the write.
+                if (::write(m_Psi, trigger.c_str(), trigger.size() + 1) < 0) {
+                    ::close(m_Psi);
+                    m_Psi = -1;
+                }
+            }
+        }
+        if (not m_Options.events.empty()) {
+            m_LastEvents = read_events();
+            m_EventsActive = m_LastEvents >= 0;
+        }
+        m_Stop = ::eventfd(0, EFD_CLOEXEC);
+        if (m_Stop >= 0 and (m_Psi >= 0 or m_EventsActive)) {
+            m_Watcher = std::thread{[this] { watch_loop(); }};
+        }
+    }
+
+    Monitor::~Monitor() {
+        if (m_Watcher.joinable()) {
+            uint64_t const one = 1;
+            [[maybe_unused]] auto const written = ::write(m_Stop, &one, sizeof(one));
+            m_Watcher.join();
+        }
+        if (m_Stop >= 0) {
+            ::close(m_Stop);
+        }
+        if (m_Psi >= 0) {
+            ::close(m_Psi);
+        }
+    }
+
+    size_t Monitor::add(Reclaimer reclaimer) {
+        std::lock_guard lock{m_Mutex};
+        m_Reclaimers.emplace_back(m_NextId, std::move(reclaimer));
+        return m_NextId++;
+    }
+
+    void Monitor::remove(size_t id) {
+        std::lock_guard lock{m_Mutex};
+        std::erase_if(m_Reclaimers, [id](auto const& reclaimer) { return reclaimer.first == id; });
+    }
+
+    size_t Monitor::reclaim() {
+        std::lock_guard lock{m_Mutex};
+        size_t released = 0;
+        for (auto const& [id, reclaimer] : m_Reclaimers) {
+            released += reclaimer();
+        }
+        return released;
+    }
+
+    size_t Monitor::rounds() const {
+        std::lock_guard lock{m_Mutex};
+        return m_Rounds;
+    }
+
+    int64_t Monitor::read_events() const {
+        std::ifstream file{m_Options.events};
+        if (not file.is_open()) {
+            return -1;
+        }
+        int64_t total = 0;
+        std::string key;
+        int64_t value;
+        while (file >> key >> value) {
+            if (key == "high" or key == "max" or key == "oom") {
+                total += value;
+            }
+        }
+        return total;
+    }
+
+    void Monitor::watch_loop() {
+        using Clock = std::chrono::steady_clock;
+        // The first signal is never held back.
+        auto last_round = Clock::now() - m_Options.cooldown;
+        pollfd fds[2] = {{m_Stop, POLLIN, 0}, {m_Psi, POLLPRI, 0}};
+        bool psi = m_Psi >= 0;
+        int const timeout = m_EventsActive ? static_cast<int>(m_Options.interval.count()) : -1;
+        while (true) {
+            fds[0].revents = fds[1].revents = 0;
+            int const ready = ::poll(fds, psi ? 2 : 1, timeout);
+            if (ready < 0 and errno != EINTR) {
+                return;
+            }
+            if (fds[0].revents != 0) {
+                return;
+            }
+            bool pressure = false;
+            if (fds[1].revents & POLLERR) {
+                // The file went away, e.g. the cgroup was removed. Keep going on memory.events alone.
+                psi = false;
+                if (not m_EventsActive) {
+                    return;
+                }
+            } else if (fds[1].revents & POLLPRI) {
+                pressure = true;
+            }
+            if (m_EventsActive) {
+                int64_t const events = read_events();
+                if (events > m_LastEvents) {
+                    pressure = true;
+                }
+                if (events >= 0) {
+                    m_LastEvents = events;
+                }
+            }
+            if (pressure and Clock::now() - last_round >= m_Options.cooldown) {
+                last_round = Clock::now();
+                reclaim();
+                std::lock_guard lock{m_Mutex};
+                ++m_Rounds;
+            }
+        }
+    }
+}
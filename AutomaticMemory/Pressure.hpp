@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Prewarm.hpp"
+
+/*
+    Reacting to memory pressure. Heaps keep free memory around for the next allocation, which is
+    what makes them fast, and what gets a container with memory.high throttled or OOM killed. A
+    Monitor watches the kernel's pressure signals on a thread of its own and, when they fire, runs
+    the reclaimers registered with it: BasicHeap::trim(), PrewarmPool::drain(), or any eviction hook
+    of the application's. A cooldown keeps it from trimming over and over while pressure lasts.
+*/
+namespace AutomaticMemory::Policies {
+    struct Locked;
+}
+
+namespace AutomaticMemory::Pressure {
+    /*
+        memory.events of the cgroup v2 group this process is in, or an empty string without one
+        (cgroup v1, or nothing mounted).
+    */
+    std::string cgroup_events();
+
+    class Monitor {
+        public:
+        struct Options {
+            // PSI file a trigger is put on, <cgroup>/memory.pressure watches the group only. Empty to not use PSI.
+            std::string psi = "/proc/pressure/memory";
+            // Fire when tasks stalled on memory for `stall` within any `window`. Without CAP_SYS_RESOURCE
+            // the kernel only accepts windows that are a multiple of 2 seconds.
+            std::chrono::microseconds stall{200'000};
+            std::chrono::microseconds window{2'000'000};
+            // Fire when the high, max or oom count in this memory.events file goes up. Empty to not watch one.
+            std::string events = cgroup_events();
+            // How often `events` is read.
+            std::chrono::milliseconds interval{1000};
+            // Least time between two rounds of reclaiming.
+            std::chrono::milliseconds cooldown{5000};
+        };
+
+        // Returns the bytes it gave back, 0 if it can't tell.
+        using Reclaimer = std::function<size_t()>;
+
+        /*
+            Starts watching right away. Signals that can't be opened (no PSI in the kernel, no permission
+            for a trigger, no cgroup v2) are skipped, psi_active() and events_active() tell which are in use.
+        */
+        explicit Monitor(Options options);
+        Monitor() : Monitor(Options{}) {}
+        Monitor(Monitor const&) = delete;
+        Monitor& operator=(Monitor const&) = delete;
+        ~Monitor();
+
+        /*
+            Registers a reclaimer, run on the monitor's thread under pressure. Returns an id for remove().
+            Reclaimers run one after the other in the order they were added.
+        */
+        size_t add(Reclaimer reclaimer);
+
+        // Unregisters a reclaimer. Waits if a round is running, so whatever it captured can go away afterwards.
+        void remove(size_t id);
+
+        /*
+            Trims `heap` under pressure. The heap has to outlive the registration. trim() runs on the monitor's
+            thread while the owner may be allocating, so only heaps with Policies::Locked are taken, a
+            SingleThreaded one won't compile.
+        */
+        template<typename Heap_> requires std::is_same_v<typename Heap_::threading_type, Policies::Locked>
+        size_t watch(Heap_& heap) {
+            return add([&heap] { return heap.trim(); });
+        }
+
+        // Drains `pool` under pressure. The pool has to outlive the registration.
+        size_t watch(Os::PrewarmPool& pool) {
+            return add([&pool] { return pool.drain(); });
+        }
+
+        // Runs every reclaimer now, pressure or not, and returns the bytes they gave back.
+        size_t reclaim();
+
+        bool psi_active() const { return m_Psi >= 0; }
+        bool events_active() const { return m_EventsActive; }
+
+        // Rounds run because of pressure so far, reclaim() calls don't count.
+        size_t rounds() const;
+
+        private:
+        void watch_loop();
+
+        // Sum of the high, max and oom counts in the events file, -1 if it can't be read.
+        int64_t read_events() const;
+
+        Options m_Options;
+        int m_Psi = -1;
+        int m_Stop = -1;
+        bool m_EventsActive = false;
+        int64_t m_LastEvents = 0;
+        size_t m_Rounds = 0;
+        size_t m_NextId = 0;
+        std::vector<std::pair<size_t, Reclaimer>> m_Reclaimers;
+        mutable std::mutex m_Mutex;
+        std::thread m_Watcher;
+    };
+}
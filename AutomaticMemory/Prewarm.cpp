@@ -0,0 +1,105 @@
+#include "Prewarm.hpp"
+#include "Os.hpp"
+
+#include <chrono>
+#include <new>
+
+namespace AutomaticMemory::Os {
+    PrewarmPool::PrewarmPool(size_t span_size, size_t spans) : m_SpanSize{round_to_pages(span_size)}, m_Spans{spans} {
+        m_Ready.reserve(spans);
+        m_Warmer = std::thread{[this] { warm(); }};
+    }
+
+    PrewarmPool::~PrewarmPool() {
+        {
+            std::lock_guard lock{m_Mutex};
+            m_Stop = true;
+        }
+        m_Wake.notify_one();
+        m_Warmer.join();
+        for (void * span : m_Ready) {
+            unmap(span, m_SpanSize);
+        }
+    }
+
+    void * PrewarmPool::take() {
+        {
+            std::lock_guard lock{m_Mutex};
+            m_Drained = false;
+            if (not m_Ready.empty()) {
+                void * span = m_Ready.back();
+                m_Ready.pop_back();
+                m_Wake.notify_one();
+                return span;
+            }
+            ++m_Misses;
+        }
+        m_Wake.notify_one();
+        return map(m_SpanSize, true);
+    }
+
+    void PrewarmPool::give_back(void * span) {
+        unmap(span, m_SpanSize);
+    }
+
+    size_t PrewarmPool::drain() {
+        std::vector<void*> spans;
+        {
+            std::lock_guard lock{m_Mutex};
+            m_Drained = true;
+            spans.swap(m_Ready);
+            m_Ready.reserve(m_Spans);
+        }
+        for (void * span : spans) {
+            unmap(span, m_SpanSize);
+        }
+        return spans.size() * m_SpanSize;
+    }
+
+    size_t PrewarmPool::ready() const {
+        std::lock_guard lock{m_Mutex};
+        return m_Ready.size();
+    }
+
+    size_t PrewarmPool::misses() const {
+        std::lock_guard lock{m_Mutex};
+        return m_Misses;
+    }
+
+    void PrewarmPool::warm() {
+        std::unique_lock lock{m_Mutex};
+        while (true) {
+            /*
+                Timed rather than a plain wait(): libstdc++ 12 exports condition_variable::wait under a new
+                symbol version (GLIBCXX_3.4.30), so a program built against it won't start where an older
+                libstdc++ gets loaded at run time. wait_for has no such requirement, and the timeout only
+                re-checks the predicate.
+            */
+            if (not m_Wake.wait_for(lock, std::chrono::seconds{1}, [this] { return m_Stop or (not m_Drained and m_Ready.size() < m_Spans); })) {
+                continue;
+            }
+            if (m_Stop) {
+                return;
+            }
+            // Mapping with MAP_POPULATE takes a while, don't hold up take() meanwhile.
+            lock.unlock();
+            void * span = nullptr;
+            try {
+                span = map(m_SpanSize, true);
+            } catch (std::bad_alloc const&) {
+                // Out of memory for now. take() maps on demand and reports its own failure.
+            }
+            lock.lock();
+            if (span == nullptr) {
+                m_Wake.wait_for(lock, std::chrono::milliseconds{10}, [this] { return m_Stop; });
+                continue;
+            }
+            if (m_Drained) {
+                // drain() ran while this one was being mapped.
+                unmap(span, m_SpanSize);
+                continue;
+            }
+            m_Ready.push_back(span);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AutomaticMemory::Os {
+    /*
+        Keeps `spans` mappings of `span_size` bytes faulted in and ready, refilled by a background
+        thread. A pool, chunk or huge block taken from here never page faults on the request path.
+        Backends use it through Os::Pages (e.g. Tlsf::Options::prewarm), but take() is usable on its own.
+
+        Spans that come back are unmapped rather than reused, they're dirty and a fresh mapping
+        is zeroed. The background thread maps a new one in their place.
+    */
+    class PrewarmPool {
+        public:
+        PrewarmPool(size_t span_size, size_t spans);
+        PrewarmPool(PrewarmPool const&) = delete;
+        PrewarmPool& operator=(PrewarmPool const&) = delete;
+        // Stops the background thread and unmaps every ready span. Spans still out have to be given back first.
+        ~PrewarmPool();
+
+        /*
+            Hands out a ready span. If the background thread fell behind, maps and prefaults one on the
+            spot, which is exactly the fault this is meant to avoid, so misses() counts those.
+        */
+        void * take();
+
+        void give_back(void * span);
+
+        /*
+            Unmaps every ready span and stops refilling until the next take(), for memory pressure.
+            Returns the bytes released.
+        */
+        size_t drain();
+
+        size_t span_size() const { return m_SpanSize; }
+        size_t ready() const;
+        size_t misses() const;
+
+        private:
+        void warm();
+
+        size_t const m_SpanSize;
+        size_t const m_Spans;
+        std::vector<void*> m_Ready;
+        size_t m_Misses = 0;
+        bool m_Drained = false;
+        bool m_Stop = false;
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::thread m_Warmer;
+    };
+}
@@ -0,0 +1,92 @@
+#include "SegmentBackend.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace AutomaticMemory::Backends {
+    Segments::~Segments() {
+        for (Mapping const& mapping : m_Mappings) {
+            Os::unmap(mapping.memory, mapping.size);
+        }
+    }
+
+    void * Segments::allocate(size_t size) {
+        return m_Segments.emplace_back(Segment{size}).data();
+    }
+
+    void * Segments::allocate_aligned(size_t size, size_t alignment) {
+        if (alignment > Os::page_size()) {
+            throw std::bad_alloc{};
+        }
+        size_t const mapped = Os::round_to_pages(size > 0 ? size : 1);
+        void * memory = Os::map(mapped);
+        adopt(memory, mapped);
+        return memory;
+    }
+
+    void Segments::adopt(void * memory, size_t size) {
+        m_Mappings.push_back(Mapping{memory, Os::round_to_pages(size)});
+    }
+
+    bool Segments::free(void * memory) {
+        auto it = find(memory);
+        if (it == m_Segments.end()) {
+            auto const mapping = find_mapping(memory);
+            if (mapping == m_Mappings.end()) { return false; }
+            Os::unmap(mapping->memory, mapping->size);
+            m_Mappings.erase(mapping);
+            return true;
+        }
+        m_Segments.erase(it);
+        // release back memory.
+        m_Segments.shrink_to_fit();
+        return true;
+    }
+
+    bool Segments::owns(void * memory) {
+        return find(memory) != m_Segments.end() or find_mapping(memory) != m_Mappings.end();
+    }
+
+    void Segments::free_all() {
+        m_Segments.clear();
+        m_Segments.shrink_to_fit();
+        for (Mapping const& mapping : m_Mappings) {
+            Os::unmap(mapping.memory, mapping.size);
+        }
+        m_Mappings.clear();
+    }
+
+    bool Segments::snapshot(size_t part, std::vector<Walk::Span>& spans) const {
+        size_t const segment_batches = (m_Segments.size() + batch - 1) / batch;
+        if (part >= segment_batches) {
+            size_t const first = (part - segment_batches) * batch;
+            if (first >= m_Mappings.size()) {
+                return false;
+            }
+            for (size_t i = first; i < std::min(first + batch, m_Mappings.size()); ++i) {
+                Mapping const& mapping = m_Mappings[i];
+                spans.push_back(Walk::Span{mapping.memory, mapping.size, {Walk::Block{mapping.memory, mapping.size, {}}}});
+            }
+            return true;
+        }
+        size_t const first = part * batch;
+        size_t const last = std::min(first + batch, m_Segments.size());
+        for (size_t i = first; i < last; ++i) {
+            auto * const memory = const_cast<unsigned char*>(m_Segments[i].m_Memory.data());
+            spans.push_back(Walk::Span{memory, m_Segments[i].size, {Walk::Block{memory, m_Segments[i].size, {}}}});
+        }
+        return true;
+    }
+
+    std::vector<Segments::Mapping>::iterator Segments::find_mapping(void * memory) {
+        return std::find_if(m_Mappings.begin(), m_Mappings.end(), [memory](Mapping const& mapping) {
+            return mapping.memory == memory;
+        });
+    }
+
+    std::vector<Segments::Segment>::iterator Segments::find(void * memory) {
+        return std::find_if(m_Segments.begin(), m_Segments.end(), [memory](Segment& segment) {
+            return segment.data() == memory;
+        });
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Os.hpp"
+#include "Walk.hpp"
+
+namespace AutomaticMemory::Backends {
+    /*
+        The original heap strategy. Every allocation is its own Segment, a fancy wrapper
+        around std::vector<unsigned char>, and the heap keeps a vector of them. Freeing
+        has to search the vector for the owning segment, so this backend is simple but
+        O(n) on free.
+    */
+    class Segments {
+        public:
+        /* Segment
+            This class represents a memory segment. Each segment is a memory space.
+            std::vector<unsigned char> is the holder for raw memory.
+        */
+        struct Segment {
+            Segment() : size(0) {}
+            // Always reserve at least a byte, zero sized segments would all share a null data() otherwise.
+            Segment(size_t size) : size{size} { m_Memory.reserve(size > 0 ? size : 1); }
+            void reserve(size_t const& size) { m_Memory.reserve(size);  this->size = size; }
+            void resize(size_t const& size) { m_Memory.resize(size);  this->size = size; }
+            void * data() {
+                return static_cast<void*>(m_Memory.data());
+            }
+            bool operator==(Segment const& other) const { return m_Memory.data() == other.m_Memory.data() and size == other.size; }
+            auto begin() { return m_Memory.begin(); }
+            auto end() { return m_Memory.end(); }
+            std::vector<unsigned char> m_Memory;
+            size_t size;
+        };
+
+        constexpr Segments() = default;
+        Segments(Segments const&) = delete;
+        Segments& operator=(Segments const&) = delete;
+        ~Segments();
+
+        /*
+            We create a segment in the segments vector with a provided size. As the segment gets constructed,
+            it reserves the requested memory size using std::vector<unsigned char>::reserve();
+        */
+        void * allocate(size_t size);
+
+        /*
+            Blocks aligned to more than 16 bytes, up to a page, are mappings of their own. Nothing is zeroed by
+            hand, the pages come zeroed and are only faulted in as they're touched. Throws std::bad_alloc for
+            alignments over a page.
+        */
+        void * allocate_aligned(size_t size, size_t alignment);
+
+        /*
+            Takes over a mapping made elsewhere, e.g. a private file mapping from Io::map_private(). From then
+            on it is a block of this heap, and freeing it unmaps it.
+        */
+        void adopt(void * memory, size_t size);
+
+        /*
+            Finds the segment that holds `memory` and releases it back immediately.
+            Returns false if the memory doesn't belong to any segment.
+        */
+        bool free(void * memory);
+
+        bool owns(void * memory);
+
+        void free_all();
+
+        /*
+            Appends the segments of batch number `part` to `spans`, every segment is a span holding one block.
+            Mapped blocks come in batches after them. For BasicHeap::walk(), returns false once `part` is past
+            the last batch.
+        */
+        bool snapshot(size_t part, std::vector<Walk::Span>& spans) const;
+
+        private:
+        // Segments per snapshot() batch.
+        static constexpr size_t batch = 256;
+
+        std::vector<Segment>::iterator find(void * memory);
+
+        // Aligned blocks and adopted mappings. Rare and big, so a plain list is enough.
+        struct Mapping {
+            void * memory;
+            size_t size;
+        };
+
+        std::vector<Mapping>::iterator find_mapping(void * memory);
+
+        std::vector<Segment> m_Segments;
+        std::vector<Mapping> m_Mappings;
+    };
+}
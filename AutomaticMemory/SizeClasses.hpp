@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace AutomaticMemory {
+    /*
+        Parameters of a size class table. Everything is generated from these at compile time,
+        so tuning the classes for a workload is changing a number here, not editing a table.
+    */
+    struct SizeClassParams {
+        // Every class is a multiple of this, and so is every object's address.
+        size_t alignment = 16;
+        // Largest size served by a class. Bigger requests go somewhere else.
+        size_t max_size = size_t{32} << 10;
+        // Worst internal fragmentation allowed for a request, in percent of the class size.
+        size_t max_waste_percent = 12;
+        // Page size the runs are built from.
+        size_t page_size = 4096;
+        // Longest run of pages a class may use for one slab.
+        size_t max_run_pages = 32;
+    };
+
+    struct SizeClass {
+        // Object size.
+        uint32_t size;
+        // Pages in one slab (run) of this class.
+        uint16_t run_pages;
+        // Objects carved out of one run.
+        uint16_t objects;
+    };
+
+    /*
+        Size class table generated from SizeClassParams.
+
+        Classes: starting at `alignment`, every next class is the biggest multiple of `alignment`
+        for which the smallest request it serves, one byte over the previous class, still wastes
+        no more than max_waste_percent of the class. So small classes are dense and the step
+        grows geometrically, at (100 / (100 - max_waste_percent)) per class.
+
+        Runs: every class gets the shortest run of pages (up to max_run_pages) whose leftover
+        tail, the part too small for another object, is within max_waste_percent of the run.
+
+        Lookup from a request size to its class is one load from a table indexed by size / alignment.
+    */
+    template<SizeClassParams Params_>
+    class SizeClassTable {
+        static_assert(Params_.alignment > 0 and (Params_.alignment & (Params_.alignment - 1)) == 0, "Alignment has to be a power of two.");
+        static_assert(Params_.max_size % Params_.alignment == 0, "Largest class has to be a multiple of the alignment.");
+        static_assert(Params_.max_waste_percent > 0 and Params_.max_waste_percent < 100, "Waste has to be a percentage.");
+        static_assert(Params_.page_size % Params_.alignment == 0, "Pages have to be a multiple of the alignment.");
+
+        static constexpr size_t next_class(size_t previous) {
+            size_t const a = Params_.alignment;
+            // Largest class for which request (previous + 1) still wastes at most max_waste_percent.
+            size_t next = (previous + 1) * 100 / (100 - Params_.max_waste_percent);
+            next = next / a * a;
+            if (next < previous + a) {
+                next = previous + a;
+            }
+            return next < Params_.max_size ? next : Params_.max_size;
+        }
+
+        static constexpr size_t count_classes() {
+            size_t count = 1;
+            for (size_t size = Params_.alignment; size < Params_.max_size; size = next_class(size)) {
+                ++count;
+            }
+            return count;
+        }
+
+        static constexpr size_t run_pages_for(size_t size) {
+            size_t pages = (size + Params_.page_size - 1) / Params_.page_size;
+            for (; pages < Params_.max_run_pages; ++pages) {
+                size_t const run = pages * Params_.page_size;
+                if ((run % size) * 100 <= run * Params_.max_waste_percent) {
+                    break;
+                }
+            }
+            return pages;
+        }
+
+        public:
+        static constexpr SizeClassParams params = Params_;
+        static constexpr size_t count = count_classes();
+
+        static constexpr std::array<SizeClass, count> classes = [] {
+            std::array<SizeClass, count> classes{};
+            size_t size = Params_.alignment;
+            for (size_t i = 0; i < count; ++i) {
+                size_t const pages = run_pages_for(size);
+                classes[i] = SizeClass{static_cast<uint32_t>(size), static_cast<uint16_t>(pages), static_cast<uint16_t>(pages * Params_.page_size / size)};
+                size = next_class(size);
+            }
+            return classes;
+        }();
+
+        static constexpr std::array<uint8_t, Params_.max_size / Params_.alignment + 1> lookup = [] {
+            std::array<uint8_t, Params_.max_size / Params_.alignment + 1> lookup{};
+            size_t index = 0;
+            for (size_t slot = 0; slot < lookup.size(); ++slot) {
+                while (classes[index].size < slot * Params_.alignment) {
+                    ++index;
+                }
+                lookup[slot] = static_cast<uint8_t>(index);
+            }
+            return lookup;
+        }();
+
+        // Class that serves `size`. Only valid for size <= max_size.
+        static constexpr size_t index(size_t size) {
+            return lookup[(size + Params_.alignment - 1) / Params_.alignment];
+        }
+
+        static constexpr size_t class_size(size_t size) {
+            return classes[index(size)].size;
+        }
+
+        private:
+        static constexpr bool valid() {
+            for (size_t i = 0; i < count; ++i) {
+                SizeClass const& c = classes[i];
+                size_t const previous = i == 0 ? 0 : classes[i - 1].size;
+                if (c.size % Params_.alignment != 0 or c.size <= previous) {
+                    return false;
+                }
+                // Smallest request of the class wastes at most max_waste_percent, unless the class is a single alignment step.
+                if (c.size - previous > Params_.alignment and (c.size - previous - 1) * 100 > c.size * Params_.max_waste_percent) {
+                    return false;
+                }
+                if (c.objects == 0 or c.objects * c.size > c.run_pages * Params_.page_size) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static_assert(count <= 256, "Class indices have to fit in a byte, raise max_waste_percent or lower max_size.");
+        static_assert(classes[0].size == Params_.alignment, "First class has to be the alignment.");
+        static_assert(classes[count - 1].size == Params_.max_size, "Last class has to be max_size.");
+        static_assert(valid(), "Generated size classes break the waste bound or don't fit their runs.");
+    };
+
+    using DefaultSizeClasses = SizeClassTable<SizeClassParams{}>;
+}
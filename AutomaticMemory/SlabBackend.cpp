@@ -0,0 +1,5 @@
+#include "SlabBackend.hpp"
+
+namespace AutomaticMemory::Backends {
+    template class BasicSlab<DefaultSizeClasses>;
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "Metrics.hpp"
+#include "Os.hpp"
+#include "SizeClasses.hpp"
+#include "TlsfBackend.hpp"
+#include "Walk.hpp"
+
+namespace AutomaticMemory::Backends {
+    /*
+        Slab backend.
+        Small requests are rounded up to a size class (see SizeClassTable) and served from runs
+        of pages that hold only objects of that class. Every class has an intrusive free list
+        and a cursor into its newest run, so allocate and free are a pop and a push. Requests
+        over the largest class go to an embedded TLSF backend.
+
+        Runs are committed bottom up out of one reserved region, and a page map remembers the
+        class of every page and where in its run the page sits, so free() finds the class and the
+        run of any pointer with two loads. Runs stay with their class once carved.
+    */
+    template<typename SizeClasses_ = DefaultSizeClasses>
+    class BasicSlab {
+        public:
+        using size_classes = SizeClasses_;
+
+        struct Options {
+            // Address space reserved for the runs.
+            size_t reserve = size_t{4} << 30;
+            // Backend for requests over the largest class.
+            Tlsf::Options large = Tlsf::Options{.pool_size = size_t{16} << 20, .grow = true};
+        };
+
+        BasicSlab() : BasicSlab(Options{}) {}
+        explicit BasicSlab(Options options) : m_Region{options.reserve}, m_Large{options.large} {
+            static_assert(size_classes::params.page_size % 4096 == 0, "Runs have to be built from whole OS pages.");
+            static_assert(size_classes::params.max_run_pages < 256, "Page offsets in a run have to fit in a byte.");
+            m_PageMapSize = Os::round_to_pages(m_Region.size() / size_classes::params.page_size);
+            m_PageMap = static_cast<uint8_t*>(Os::map(m_PageMapSize));
+            m_RunPages = static_cast<uint8_t*>(Os::map(m_PageMapSize));
+        }
+        BasicSlab(BasicSlab const&) = delete;
+        BasicSlab& operator=(BasicSlab const&) = delete;
+        ~BasicSlab() {
+            Os::unmap(m_RunPages, m_PageMapSize);
+            Os::unmap(m_PageMap, m_PageMapSize);
+        }
+
+        void * allocate(size_t size) {
+            if (size > size_classes::params.max_size) {
+                return m_Large.allocate(size);
+            }
+            return allocate_small(size_classes::index(size));
+        }
+
+        /*
+            Runs start on a page and hold objects back to back, so every object of a class whose size is
+            a multiple of `alignment` is aligned. Picks the first such class that fits, alignments over
+            a page go to the large backend.
+        */
+        void * allocate_aligned(size_t size, size_t alignment) {
+            if (alignment <= size_classes::params.alignment) {
+                return allocate(size);
+            }
+            size_t const rounded = (size + alignment - 1) & ~(alignment - 1);
+            if (alignment > size_classes::params.page_size or rounded > size_classes::params.max_size) {
+                return m_Large.allocate_aligned(size, alignment);
+            }
+            for (size_t index = size_classes::index(rounded); index < size_classes::count; ++index) {
+                if (size_classes::classes[index].size % alignment == 0) {
+                    return allocate_small(index);
+                }
+            }
+            return m_Large.allocate_aligned(size, alignment);
+        }
+
+        /*
+            Only objects handed out and not freed yet go back on a free list: pointers into pages no run
+            was cut from, into the middle of an object or past what a run handed out, and second frees,
+            all return false. The interposer frees whatever the process passes to free() through here.
+        */
+        bool free(void * memory) {
+            if (not m_Region.contains(memory)) {
+                return m_Large.free(memory);
+            }
+            size_t const index = live_class_of(memory);
+            if (index == no_class) {
+                return false;
+            }
+            free_small(memory, index);
+            return true;
+        }
+
+        /*
+            free() for a block allocate() gave out for `size` bytes: a large one goes straight to the large
+            backend, a small one skips the class lookup and is checked like in free() against the class the
+            size says. Not for small blocks from allocate_aligned(), those may sit in a bigger class and
+            return false like memory that isn't ours.
+        */
+        bool free_sized(void * memory, size_t size) {
+            if (size > size_classes::params.max_size) {
+                return m_Large.free(memory);
+            }
+            size_t const index = size_classes::index(size);
+            if (not m_Region.contains(memory) or live_class_of(memory) != index) {
+                return false;
+            }
+            free_small(memory, index);
+            return true;
+        }
+
+        bool owns(void * memory) const {
+            return m_Region.contains(memory) or m_Large.owns(memory);
+        }
+
+        size_t usable_size(void * memory) const {
+            if (not m_Region.contains(memory)) {
+                return m_Large.usable_size(memory);
+            }
+            return size_classes::classes[m_PageMap[page_of(memory)]].size;
+        }
+
+        size_t reserved() const {
+            return m_Region.committed() + m_Large.reserved();
+        }
+
+        // Live objects of a size class and how many its runs have room for, for metrics.
+        Metrics::Occupancy occupancy(size_t index) const {
+            SizeClass const& size_class = size_classes::classes[index];
+            return Metrics::Occupancy{size_class.size, m_Classes[index].live, m_Classes[index].runs * size_class.objects};
+        }
+
+        /*
+            Appends the runs of size class number `part`, one span each, to `spans`, for BasicHeap::walk().
+            Parts past the classes are the large backend's pools. Returns false once `part` is past those too.
+            A class's free list is gathered once per snapshot, so that's what a walk costs under the lock.
+        */
+        bool snapshot(size_t part, std::vector<Walk::Span>& spans) const {
+            if (part >= size_classes::count) {
+                return m_Large.snapshot(part - size_classes::count, spans);
+            }
+            ClassState const& state = m_Classes[part];
+            std::vector<void const*> free;
+            for (FreeObject const * object = state.free; object != nullptr; object = object->next) {
+                free.push_back(object);
+            }
+            std::sort(free.begin(), free.end());
+            SizeClass const& size_class = size_classes::classes[part];
+            auto * const base = static_cast<unsigned char*>(m_Region.base());
+            for (auto * run = base; run < m_RunCursor;) {
+                uint8_t const index = m_PageMap[page_of(run)];
+                size_t const run_size = size_classes::classes[index].run_pages * size_classes::params.page_size;
+                if (index == part) {
+                    Walk::Span& span = spans.emplace_back(Walk::Span{run, run_size, {}});
+                    // Objects past the cursor of the newest run were never handed out.
+                    unsigned char * const full = run + size_class.objects * size_class.size;
+                    bool const newest = state.cursor >= run and state.cursor <= full;
+                    unsigned char * const end = newest ? state.cursor : full;
+                    for (unsigned char * object = run; object < end; object += size_class.size) {
+                        if (not std::binary_search(free.begin(), free.end(), static_cast<void const*>(object))) {
+                            span.blocks.push_back(Walk::Block{object, size_class.size, {}});
+                        }
+                    }
+                }
+                run += run_size;
+            }
+            return true;
+        }
+
+        /*
+            Forgets every allocation. Runs are decommitted and the region starts from the bottom again.
+        */
+        void free_all() {
+            std::memset(m_PageMap, 0, m_Region.committed() / size_classes::params.page_size);
+            std::memset(m_RunPages, 0, m_Region.committed() / size_classes::params.page_size);
+            if (m_Region.committed() > 0) {
+                m_Region.decommit(m_Region.base(), m_Region.committed());
+            }
+            m_Classes = {};
+            m_RunCursor = m_RunEnd = static_cast<unsigned char*>(m_Region.base());
+            m_Large.free_all();
+        }
+
+        /*
+            Gives back what was never handed out: the committed part of the region no run was cut from yet
+            and the tail of every class's newest run, plus the large backend's free blocks, see Os::purge().
+            Freed objects inside runs stay put. Returns the bytes released.
+        */
+        size_t purge() {
+            size_t released = m_Large.purge();
+            for (ClassState const& state : m_Classes) {
+                if (state.cursor != nullptr and state.end > state.cursor) {
+                    released += Os::purge(state.cursor, state.end - state.cursor);
+                }
+            }
+            if (m_RunCursor != nullptr and m_RunEnd > m_RunCursor) {
+                released += Os::purge(m_RunCursor, m_RunEnd - m_RunCursor);
+            }
+            return released;
+        }
+
+        private:
+        // Runs are committed from the region this many bytes at a time.
+        static constexpr size_t commit_chunk = size_t{1} << 20;
+
+        // live_class_of() for anything that isn't a live object.
+        static constexpr size_t no_class = ~size_t{0};
+        /*
+            Freed objects carry this, xor their address, next to the list link, and lose it again when handed
+            out, which is how a second free is told apart. Classes too small for it (tables with an alignment
+            of 8) only get the position checks.
+        */
+        static constexpr uintptr_t free_marker = 0x5a1bf4eeded0b1ec;
+
+        struct FreeObject {
+            FreeObject * next;
+            uintptr_t marker;
+        };
+
+        static bool marked(size_t index) {
+            return size_classes::classes[index].size >= sizeof(FreeObject);
+        }
+
+        struct ClassState {
+            FreeObject * free = nullptr;
+            unsigned char * cursor = nullptr;
+            unsigned char * end = nullptr;
+            size_t live = 0;
+            size_t runs = 0;
+        };
+
+        size_t page_of(void const * memory) const {
+            return (static_cast<unsigned char const*>(memory) - static_cast<unsigned char*>(m_Region.base())) / size_classes::params.page_size;
+        }
+
+        // Class of `memory`, an address in the region, if it's the start of an object that's handed out right now.
+        size_t live_class_of(void * memory) const {
+            auto * const address = static_cast<unsigned char*>(memory);
+            // Pages below the run cursor are committed and belong to a run, the rest never held an object.
+            if (address >= m_RunCursor) {
+                return no_class;
+            }
+            size_t const page = page_of(address);
+            uint8_t const offset = m_RunPages[page];
+            if (offset == 0) {
+                return no_class;
+            }
+            size_t const index = m_PageMap[page];
+            SizeClass const& size_class = size_classes::classes[index];
+            unsigned char * const run = static_cast<unsigned char*>(m_Region.base()) + (page - (offset - 1)) * size_classes::params.page_size;
+            size_t const position = static_cast<size_t>(address - run);
+            if (position % size_class.size != 0 or position / size_class.size >= size_class.objects) {
+                return no_class;
+            }
+            // The newest run of the class hasn't handed out anything from its cursor on.
+            ClassState const& state = m_Classes[index];
+            if (state.cursor >= run and state.cursor <= run + size_class.objects * size_class.size and address >= state.cursor) {
+                return no_class;
+            }
+            if (marked(index) and static_cast<FreeObject const*>(memory)->marker == (reinterpret_cast<uintptr_t>(memory) ^ free_marker)) {
+                return no_class;
+            }
+            return index;
+        }
+
+        void * allocate_small(size_t index) {
+            ClassState& state = m_Classes[index];
+            if (state.free != nullptr) {
+                FreeObject * object = state.free;
+                state.free = object->next;
+                if (marked(index)) {
+                    object->marker = 0;
+                }
+                ++state.live;
+                return object;
+            }
+            size_t const size = size_classes::classes[index].size;
+            if (state.cursor == nullptr or static_cast<size_t>(state.end - state.cursor) < size) {
+                new_run(index);
+            }
+            void * object = state.cursor;
+            state.cursor += size;
+            ++state.live;
+            return object;
+        }
+
+        void free_small(void * memory, size_t index) {
+            auto * object = static_cast<FreeObject*>(memory);
+            object->next = m_Classes[index].free;
+            if (marked(index)) {
+                object->marker = reinterpret_cast<uintptr_t>(memory) ^ free_marker;
+            }
+            m_Classes[index].free = object;
+            --m_Classes[index].live;
+        }
+
+        void new_run(size_t index) {
+            SizeClass const& size_class = size_classes::classes[index];
+            size_t const run = size_class.run_pages * size_classes::params.page_size;
+            if (m_RunCursor == nullptr) {
+                m_RunCursor = m_RunEnd = static_cast<unsigned char*>(m_Region.base());
+            }
+            while (static_cast<size_t>(m_RunEnd - m_RunCursor) < run) {
+                // Commits are contiguous, so the new chunk extends the current one. Throws std::bad_alloc when the region is full.
+                m_RunEnd = static_cast<unsigned char*>(m_Region.commit(commit_chunk)) + commit_chunk;
+            }
+            std::memset(m_PageMap + page_of(m_RunCursor), static_cast<int>(index), size_class.run_pages);
+            for (size_t page = 0; page < size_class.run_pages; ++page) {
+                m_RunPages[page_of(m_RunCursor) + page] = static_cast<uint8_t>(page + 1);
+            }
+            ClassState& state = m_Classes[index];
+            state.cursor = m_RunCursor;
+            state.end = m_RunCursor + size_class.objects * size_class.size;
+            ++state.runs;
+            m_RunCursor += run;
+        }
+
+        Os::Reservation m_Region;
+        Tlsf m_Large;
+        // Size class of every page in the region.
+        uint8_t * m_PageMap;
+        // Position of every page in its run, counting from 1. 0 for pages no run was cut from.
+        uint8_t * m_RunPages;
+        size_t m_PageMapSize;
+        std::array<ClassState, size_classes::count> m_Classes{};
+        unsigned char * m_RunCursor = nullptr;
+        unsigned char * m_RunEnd = nullptr;
+    };
+
+    // The default tables are instantiated once, in SlabBackend.cpp.
+    extern template class BasicSlab<DefaultSizeClasses>;
+    using Slab = BasicSlab<>;
+}
@@ -0,0 +1,306 @@
+#include "TlsfBackend.hpp"
+
+#include <bit>
+#include <new>
+
+namespace AutomaticMemory::Backends {
+    Tlsf::~Tlsf() {
+        while (m_Pools != nullptr) {
+            Pool * pool = m_Pools;
+            m_Pools = pool->next;
+            m_Pages.unmap(pool, pool->size);
+        }
+    }
+
+    void * Tlsf::allocate(size_t size) {
+        if (size > max_request) {
+            throw std::bad_alloc{};
+        }
+        size_t const adjusted = adjust(size);
+        Block * block = locate_free(adjusted);
+        if (block == nullptr) {
+            bool const first = m_Pools == nullptr;
+            if (not first and not m_Options.grow) {
+                throw std::bad_alloc{};
+            }
+            add_pool(m_Options.grow ? pool_for(adjusted) : m_Options.pool_size);
+            block = locate_free(adjusted);
+            if (block == nullptr) {
+                throw std::bad_alloc{};
+            }
+        }
+        trim(block, adjusted);
+        block->set_used();
+        return block->payload();
+    }
+
+    void * Tlsf::allocate_aligned(size_t size, size_t alignment) {
+        if (alignment <= Tlsf::alignment) {
+            return allocate(size);
+        }
+        if (size > max_request or alignment > max_request - size) {
+            throw std::bad_alloc{};
+        }
+        size_t const adjusted = adjust(size);
+        // Enough for the payload at any alignment, with room for a free block in front of it.
+        size_t const padded = adjust(adjusted + alignment + header_size + min_block);
+        Block * block = locate_free(padded);
+        if (block == nullptr) {
+            bool const first = m_Pools == nullptr;
+            if (not first and not m_Options.grow) {
+                throw std::bad_alloc{};
+            }
+            add_pool(m_Options.grow ? pool_for(padded) : m_Options.pool_size);
+            block = locate_free(padded);
+            if (block == nullptr) {
+                throw std::bad_alloc{};
+            }
+        }
+        auto const payload = reinterpret_cast<uintptr_t>(block->payload());
+        uintptr_t aligned = (payload + alignment - 1) & ~(alignment - 1);
+        if (aligned != payload and aligned - payload < header_size + min_block) {
+            // The gap is too small to be a block of its own, skip to the next aligned address.
+            aligned = (payload + header_size + min_block + alignment - 1) & ~(alignment - 1);
+        }
+        if (aligned != payload) {
+            size_t const gap = aligned - payload;
+            auto * moved = Block::from_payload(reinterpret_cast<void*>(aligned));
+            moved->header = block->size() - gap;
+            moved->prev_phys = block;
+            moved->next_phys()->prev_phys = moved;
+            block->header = gap - header_size;
+            block->set_free();
+            // The block in front of it is used, free neighbours are always merged.
+            insert_free(block);
+            block = moved;
+        }
+        trim(block, adjusted);
+        block->set_used();
+        return block->payload();
+    }
+
+    bool Tlsf::free(void * memory) {
+        // A used block of ours has its header in a pool and its next neighbour pointing back at it. Anything else,
+        // a foreign pointer, one into the middle of a block or a second free, is refused before it reaches the lists.
+        if (reinterpret_cast<uintptr_t>(memory) % alignment != 0) {
+            return false;
+        }
+        Block * block = Block::from_payload(memory);
+        if (not owns(block) or block->is_free() or block->size() == 0) {
+            return false;
+        }
+        Block * next = block->next_phys();
+        if (not owns(next) or next->prev_phys != block) {
+            return false;
+        }
+        block->set_free();
+        block = merge_prev(block);
+        block = merge_next(block);
+        insert_free(block);
+        return true;
+    }
+
+    bool Tlsf::owns(void const * memory) const {
+        if (Os::Reservation const * reservation = m_Pages.reservation()) {
+            return reservation->committed_contains(memory);
+        }
+        auto const address = reinterpret_cast<uintptr_t>(memory);
+        for (Pool const * pool = m_Pools; pool != nullptr; pool = pool->next) {
+            auto const begin = reinterpret_cast<uintptr_t>(pool);
+            if (address >= begin and address < begin + pool->size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Tlsf::snapshot(size_t part, std::vector<Walk::Span>& spans) const {
+        Pool * pool = m_Pools;
+        for (size_t i = 0; i < part and pool != nullptr; ++i) {
+            pool = pool->next;
+        }
+        if (pool == nullptr) {
+            return false;
+        }
+        Walk::Span& span = spans.emplace_back(Walk::Span{pool, pool->size, {}});
+        auto * block = reinterpret_cast<Block*>(reinterpret_cast<unsigned char*>(pool) + pool_header);
+        // The sentinel is the only used block of size zero.
+        for (; block->size() > 0 or block->is_free(); block = block->next_phys()) {
+            if (not block->is_free()) {
+                span.blocks.push_back(Walk::Block{block->payload(), block->size(), {}});
+            }
+        }
+        return true;
+    }
+
+    size_t Tlsf::reserved() const {
+        size_t total = 0;
+        for (Pool const * pool = m_Pools; pool != nullptr; pool = pool->next) {
+            total += pool->size;
+        }
+        return total;
+    }
+
+    void Tlsf::free_all() {
+        m_FlBitmap = 0;
+        for (size_t fl = 0; fl < fl_count; ++fl) {
+            m_SlBitmap[fl] = 0;
+            for (size_t sl = 0; sl < sl_count; ++sl) {
+                m_Blocks[fl][sl] = nullptr;
+            }
+        }
+        for (Pool * pool = m_Pools; pool != nullptr; pool = pool->next) {
+            format_pool(pool);
+        }
+    }
+
+    size_t Tlsf::purge() {
+        size_t released = 0;
+        for (Pool * pool = m_Pools; pool != nullptr; pool = pool->next) {
+            auto * block = reinterpret_cast<Block*>(reinterpret_cast<unsigned char*>(pool) + pool_header);
+            for (; block->size() > 0 or block->is_free(); block = block->next_phys()) {
+                if (block->is_free() and block->size() > min_block) {
+                    // The free list links at the start of the payload have to survive.
+                    released += Os::purge(static_cast<unsigned char*>(block->payload()) + min_block, block->size() - min_block);
+                }
+            }
+        }
+        return released;
+    }
+
+    void Tlsf::mapping(size_t size, size_t& fl, size_t& sl) {
+        if (size < small_block) {
+            fl = 0;
+            sl = size / alignment;
+        } else {
+            size_t const bit = std::bit_width(size) - 1;
+            sl = (size >> (bit - sl_log2)) ^ sl_count;
+            fl = bit - fl_shift + 1;
+        }
+    }
+
+    void Tlsf::mapping_search(size_t size, size_t& fl, size_t& sl) {
+        if (size >= small_block) {
+            size += (size_t{1} << (std::bit_width(size) - 1 - sl_log2)) - 1;
+        }
+        mapping(size, fl, sl);
+    }
+
+    Tlsf::Block * Tlsf::locate_free(size_t size) {
+        size_t fl, sl;
+        mapping_search(size, fl, sl);
+        if (fl >= fl_count) {
+            return nullptr;
+        }
+        uint32_t sl_map = m_SlBitmap[fl] & (~uint32_t{0} << sl);
+        if (sl_map == 0) {
+            uint32_t const fl_map = fl + 1 < fl_count ? m_FlBitmap & (~uint32_t{0} << (fl + 1)) : 0;
+            if (fl_map == 0) {
+                return nullptr;
+            }
+            fl = std::countr_zero(fl_map);
+            sl_map = m_SlBitmap[fl];
+        }
+        sl = std::countr_zero(sl_map);
+        Block * block = m_Blocks[fl][sl];
+        remove_free(block, fl, sl);
+        return block;
+    }
+
+    void Tlsf::insert_free(Block * block) {
+        size_t fl, sl;
+        mapping(block->size(), fl, sl);
+        Block * head = m_Blocks[fl][sl];
+        block->next_free = head;
+        block->prev_free = nullptr;
+        if (head != nullptr) {
+            head->prev_free = block;
+        }
+        m_Blocks[fl][sl] = block;
+        m_FlBitmap |= uint32_t{1} << fl;
+        m_SlBitmap[fl] |= uint32_t{1} << sl;
+    }
+
+    void Tlsf::remove_free(Block * block, size_t fl, size_t sl) {
+        if (block->prev_free != nullptr) {
+            block->prev_free->next_free = block->next_free;
+        } else {
+            m_Blocks[fl][sl] = block->next_free;
+            if (block->next_free == nullptr) {
+                m_SlBitmap[fl] &= ~(uint32_t{1} << sl);
+                if (m_SlBitmap[fl] == 0) {
+                    m_FlBitmap &= ~(uint32_t{1} << fl);
+                }
+            }
+        }
+        if (block->next_free != nullptr) {
+            block->next_free->prev_free = block->prev_free;
+        }
+    }
+
+    void Tlsf::remove_free(Block * block) {
+        size_t fl, sl;
+        mapping(block->size(), fl, sl);
+        remove_free(block, fl, sl);
+    }
+
+    void Tlsf::trim(Block * block, size_t size) {
+        if (block->size() < size + header_size + min_block) {
+            return;
+        }
+        auto * remaining = reinterpret_cast<Block*>(static_cast<unsigned char*>(block->payload()) + size);
+        remaining->header = block->size() - size - header_size;
+        remaining->prev_phys = block;
+        remaining->set_free();
+        remaining->next_phys()->prev_phys = remaining;
+        block->set_size(size);
+        insert_free(remaining);
+    }
+
+    Tlsf::Block * Tlsf::merge_prev(Block * block) {
+        Block * prev = block->prev_phys;
+        if (prev == nullptr or not prev->is_free()) {
+            return block;
+        }
+        remove_free(prev);
+        prev->set_size(prev->size() + header_size + block->size());
+        prev->next_phys()->prev_phys = prev;
+        return prev;
+    }
+
+    Tlsf::Block * Tlsf::merge_next(Block * block) {
+        Block * next = block->next_phys();
+        if (not next->is_free()) {
+            return block;
+        }
+        remove_free(next);
+        block->set_size(block->size() + header_size + next->size());
+        block->next_phys()->prev_phys = block;
+        return block;
+    }
+
+    void Tlsf::add_pool(size_t size) {
+        size = Os::round_to_pages(size);
+        // Keep the whole pool addressable by the first level.
+        size_t const limit = Os::round_to_pages(max_request) - Os::page_size();
+        if (size > limit) {
+            size = limit;
+        }
+        auto * pool = static_cast<Pool*>(m_Pages.map(size));
+        pool->next = m_Pools;
+        pool->size = size;
+        m_Pools = pool;
+        format_pool(pool);
+    }
+
+    void Tlsf::format_pool(Pool * pool) {
+        auto * block = reinterpret_cast<Block*>(reinterpret_cast<unsigned char*>(pool) + pool_header);
+        block->prev_phys = nullptr;
+        block->header = pool->size - pool_header - 2 * header_size;
+        block->set_free();
+        Block * sentinel = block->next_phys();
+        sentinel->prev_phys = block;
+        sentinel->header = 0;
+        insert_free(block);
+    }
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Os.hpp"
+#include "Walk.hpp"
+
+namespace AutomaticMemory::Backends {
+    /*
+        Two-Level Segregated Fit backend.
+        Memory is carved out of a few big pools that are mapped up front. Free blocks are kept
+        in segregated lists indexed by two levels: the first level is the power of two of the
+        block size, the second level splits every power of two into `sl_count` linear ranges.
+        Two bitmaps tell which lists are non-empty, so finding a fitting block is a couple of
+        bit scans and never a search. Freed blocks are merged with their physical neighbours
+        immediately, so allocate and free are both O(1) in the worst case.
+
+        Pool layout:
+        [pool|hdr|payload.........][hdr|payload....][hdr|payload.........][hdr(sentinel, size 0)]
+          |    \_ prev_phys = null    \_ prev_phys points to the block before it, always valid.
+          \_ link to the previously mapped pool, so the backend never allocates bookkeeping elsewhere.
+
+        The only call that is not bounded is the one that maps a new pool, which happens
+        only if Options::grow is set. Latency critical users should size the pool so that
+        it never has to grow.
+    */
+    class Tlsf {
+        public:
+        struct Options {
+            // Size of the pool mapped at construction.
+            size_t pool_size = size_t{64} << 20;
+            // Map another pool when the existing ones are exhausted instead of throwing std::bad_alloc.
+            bool grow = false;
+            // If set, reserve this much contiguous address space up front and commit the pools out of it,
+            // e.g. size_t{64} << 30. Pools then sit back to back and owns() is a single range compare.
+            size_t reserve = 0;
+            // Map the first pool on the first allocation instead of at construction. Keeps construction
+            // constexpr, at the price of one slow first allocation.
+            bool lazy = false;
+            // Fault every pool in as it's mapped, so allocations never page fault. Costs the whole
+            // pool in resident memory up front.
+            bool populate = false;
+            // Take pools of exactly the pool size from here, pre-faulted by a background thread.
+            // Makes growing fault free as well. The pool has to outlive the backend.
+            Os::PrewarmPool * prewarm = nullptr;
+        };
+
+        constexpr explicit Tlsf(Options options) : m_Options{options}, m_Pages{options.reserve, options.populate, options.prewarm} {
+            if (not m_Options.lazy) {
+                add_pool(m_Options.pool_size);
+            }
+        }
+        Tlsf(Tlsf const&) = delete;
+        Tlsf& operator=(Tlsf const&) = delete;
+        ~Tlsf();
+
+        void * allocate(size_t size);
+
+        /*
+            Like allocate(), with the payload aligned to `alignment` (a power of two). The gap in front
+            of the aligned payload is split off as a free block, so nothing is wasted for good.
+        */
+        void * allocate_aligned(size_t size, size_t alignment);
+
+        /*
+            Returns the block to its free list, merging it with its free neighbours first. Returns false,
+            touching nothing, for memory that isn't a live block of this backend: foreign pointers, pointers
+            into the middle of a block and blocks that were freed already. The check is owns() twice plus
+            two header reads.
+        */
+        bool free(void * memory);
+
+        bool owns(void const * memory) const;
+
+        // The real size of the block behind `memory`. Never less than what was requested.
+        size_t usable_size(void * memory) const {
+            return Block::from_payload(memory)->size();
+        }
+
+        size_t reserved() const;
+
+        /*
+            Appends the live blocks of pool number `part` to `spans`, for BasicHeap::walk().
+            Returns false once `part` is past the last one.
+        */
+        bool snapshot(size_t part, std::vector<Walk::Span>& spans) const;
+
+        /*
+            Forgets every allocation. Pools are kept mapped and each one becomes a single free block again.
+        */
+        void free_all();
+
+        /*
+            Gives the pages inside free blocks back to the OS, see Os::purge(). Pools stay mapped, so this
+            is for memory pressure rather than the request path: it visits every block of every pool.
+            Returns the bytes released.
+        */
+        size_t purge();
+
+        private:
+        static constexpr size_t align_log2 = 4;
+        static constexpr size_t alignment = size_t{1} << align_log2;
+        static constexpr size_t sl_log2 = 5;
+        static constexpr size_t sl_count = size_t{1} << sl_log2;
+        // Blocks smaller than this all live in the first level, split linearly by `alignment`.
+        static constexpr size_t fl_shift = sl_log2 + align_log2;
+        static constexpr size_t small_block = size_t{1} << fl_shift;
+        static constexpr size_t fl_max = 40;
+        static constexpr size_t fl_count = fl_max - fl_shift + 1;
+
+        static_assert(fl_count <= 32, "First level bitmap has to fit in 32 bits.");
+        static_assert(small_block / sl_count == alignment, "Small blocks have to be split by alignment.");
+
+        struct Block {
+            // Physically previous block, null for the first block of a pool.
+            Block * prev_phys;
+            // Payload size, the lowest bit tells whether the block is free.
+            size_t header;
+            // Free list links. Only meaningful while the block is free, otherwise this is payload.
+            Block * next_free;
+            Block * prev_free;
+
+            size_t size() const { return header & ~size_t{1}; }
+            void set_size(size_t size) { header = size | (header & 1); }
+            bool is_free() const { return header & 1; }
+            void set_free() { header |= 1; }
+            void set_used() { header &= ~size_t{1}; }
+
+            void * payload() { return reinterpret_cast<unsigned char*>(this) + header_size; }
+            Block * next_phys() { return reinterpret_cast<Block*>(static_cast<unsigned char*>(payload()) + size()); }
+            static Block * from_payload(void * memory) {
+                return reinterpret_cast<Block*>(static_cast<unsigned char*>(memory) - header_size);
+            }
+        };
+
+        static constexpr size_t header_size = offsetof(Block, next_free);
+        static constexpr size_t min_block = sizeof(Block) - header_size;
+        static constexpr size_t max_request = (size_t{1} << fl_max) - small_block;
+
+        static_assert(header_size % alignment == 0, "Payloads have to stay aligned after the header.");
+
+        // Lives in the first bytes of every pool. Pools form a list, newest first.
+        struct Pool {
+            Pool * next;
+            size_t size;
+        };
+
+        static constexpr size_t pool_header = (sizeof(Pool) + alignment - 1) & ~(alignment - 1);
+
+        static size_t adjust(size_t size) {
+            size_t const aligned = (size + alignment - 1) & ~(alignment - 1);
+            return aligned < min_block ? min_block : aligned;
+        }
+
+        static void mapping(size_t size, size_t& fl, size_t& sl);
+
+        // Rounds `size` up to the next list boundary, so any block in the found list is big enough.
+        static void mapping_search(size_t size, size_t& fl, size_t& sl);
+
+        Block * locate_free(size_t size);
+
+        void insert_free(Block * block);
+
+        void remove_free(Block * block, size_t fl, size_t sl);
+
+        void remove_free(Block * block);
+
+        // Splits the tail of `block` off into a new free block if it is big enough to be one.
+        void trim(Block * block, size_t size);
+
+        Block * merge_prev(Block * block);
+
+        Block * merge_next(Block * block);
+
+        /*
+            Pool size that can serve a `size` byte block. The search rounds requests up to the next list,
+            by up to size >> sl_log2, so the pool's single free block has to be at least that big.
+        */
+        size_t pool_for(size_t size) const {
+            size_t const needed = pool_header + size + (size >> sl_log2) + 2 * header_size;
+            return needed > m_Options.pool_size ? needed : m_Options.pool_size;
+        }
+
+        void add_pool(size_t size);
+
+        // Turns the whole pool into one free block followed by a used, zero sized sentinel.
+        void format_pool(Pool * pool);
+
+        Options m_Options;
+        Os::Pages m_Pages;
+        uint32_t m_FlBitmap = 0;
+        uint32_t m_SlBitmap[fl_count] = {};
+        Block * m_Blocks[fl_count][sl_count] = {};
+        Pool * m_Pools = nullptr;
+    };
+}
@@ -0,0 +1,144 @@
+#include "Walk.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <execinfo.h>
+
+namespace AutomaticMemory::Walk {
+    namespace {
+        constexpr char const * magic = "passivegc-heap-dump 1";
+
+        char const * kind_name(Accounting::Kind kind) {
+            switch (kind) {
+                case Accounting::Kind::Type: return "type";
+                case Accounting::Kind::Tag: return "tag";
+                default: return "untagged";
+            }
+        }
+
+        Accounting::Kind kind_of(std::string const& name) {
+            if (name == "type") { return Accounting::Kind::Type; }
+            if (name == "tag") { return Accounting::Kind::Tag; }
+            return Accounting::Kind::Untagged;
+        }
+
+        std::vector<std::string> split(std::string const& line, char separator) {
+            std::vector<std::string> fields;
+            std::string field;
+            std::istringstream input{line};
+            while (std::getline(input, field, separator)) {
+                fields.push_back(field);
+            }
+            return fields;
+        }
+
+        // std::stoull, minus its habit of stopping quietly at the first stray character.
+        unsigned long long number(std::string const& field, int base) {
+            size_t used = 0;
+            unsigned long long const value = std::stoull(field, &used, base);
+            if (used != field.size()) {
+                throw std::invalid_argument{field};
+            }
+            return value;
+        }
+    }
+
+    size_t capture(std::array<void*, Sample::max_frames>& frames) {
+        // One more, to drop this function's own frame.
+        std::array<void*, Sample::max_frames + 1> stack;
+        int const depth = ::backtrace(stack.data(), static_cast<int>(stack.size()));
+        if (depth <= 1) {
+            return 0;
+        }
+        std::copy(stack.begin() + 1, stack.begin() + depth, frames.begin());
+        return static_cast<size_t>(depth - 1);
+    }
+
+    void write_header(std::ostream& output) {
+        output << magic << '\n';
+    }
+
+    void write_span(std::ostream& output, Span const& span) {
+        output << "span\t" << span.base << '\t' << span.size << '\n';
+        for (Block const& block : span.blocks) {
+            output << "block\t" << block.address << '\t' << block.size;
+            if (block.sample) {
+                output << '\t' << kind_name(block.sample->key.kind) << '\t' << block.sample->key.name << '\t';
+                for (size_t frame = 0; frame < block.sample->depth; ++frame) {
+                    output << (frame > 0 ? "," : "") << block.sample->frames[frame];
+                }
+            }
+            output << '\n';
+        }
+    }
+
+    DumpFile::DumpFile(std::string path) : m_Path{std::move(path)}, m_Output{std::make_unique<std::ofstream>(m_Path + ".tmp", std::ios::trunc)} {
+        write_header(*m_Output);
+    }
+
+    DumpFile::~DumpFile() {
+        if (not m_Committed) {
+            m_Output.reset();
+            std::remove((m_Path + ".tmp").c_str());
+        }
+    }
+
+    void DumpFile::write(Span const& span) {
+        write_span(*m_Output, span);
+    }
+
+    bool DumpFile::commit() {
+        m_Output->close();
+        if (m_Output->fail()) {
+            return false;
+        }
+        m_Committed = std::rename((m_Path + ".tmp").c_str(), m_Path.c_str()) == 0;
+        return m_Committed;
+    }
+
+    std::optional<std::vector<DumpedSpan>> read_dump(std::istream& input) {
+        std::string line;
+        if (not std::getline(input, line) or line != magic) {
+            return std::nullopt;
+        }
+        std::vector<DumpedSpan> spans;
+        try {
+            while (std::getline(input, line)) {
+                std::vector<std::string> const fields = split(line, '\t');
+                if (fields.size() < 3) {
+                    continue;
+                }
+                uintptr_t const address = number(fields[1], 16);
+                size_t const size = number(fields[2], 10);
+                if (fields[0] == "span") {
+                    spans.push_back(DumpedSpan{address, size, {}});
+                } else if (fields[0] == "block" and not spans.empty()) {
+                    DumpedBlock& block = spans.back().blocks.emplace_back();
+                    block.address = address;
+                    block.size = size;
+                    if (fields.size() >= 5) {
+                        block.sampled = true;
+                        block.kind = kind_of(fields[3]);
+                        block.name = fields[4];
+                    }
+                    if (fields.size() >= 6) {
+                        for (std::string const& frame : split(fields[5], ',')) {
+                            block.frames.push_back(number(frame, 16));
+                        }
+                    }
+                }
+            }
+        } catch (std::logic_error const&) {
+            // invalid_argument or out_of_range from number(): a truncated or hand-edited dump.
+            return std::nullopt;
+        }
+        return spans;
+    }
+}
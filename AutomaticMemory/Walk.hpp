@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Accounting.hpp"
+
+/*
+    Heap walking: the live blocks of a heap, what they were allocated as and where, if that
+    allocation was sampled (see Policies::BasicAccountedStats). BasicHeap::walk() gets the blocks
+    from its backend one part at a time, a pool, a root, a size class, under the heap's lock,
+    and hands them out after unlocking, so allocation goes on between parts and the visitor can
+    allocate too. Every part is consistent in itself, parts taken at different times may not be.
+
+    Walks can be dumped to a text file and read back, tools/heap_analyze.cpp reports on the dumps.
+*/
+namespace AutomaticMemory::Walk {
+    struct Sample {
+        static constexpr size_t max_frames = 16;
+
+        Accounting::Key key;
+        std::array<void*, max_frames> frames{};
+        size_t depth = 0;
+    };
+
+    // Return addresses of the caller's stack, innermost first. Only for samples, it's not cheap.
+    size_t capture(std::array<void*, Sample::max_frames>& frames);
+
+    struct Block {
+        void * address;
+        size_t size;
+        std::optional<Sample> sample;
+    };
+
+    // A contiguous range a backend manages, a pool, a run or a chunk, and the live blocks in it by address.
+    struct Span {
+        void * base;
+        size_t size;
+        std::vector<Block> blocks;
+    };
+
+    /*
+        Writes spans in the dump format, one line per span and per block, tab separated:
+            passivegc-heap-dump 1
+            span    <base>      <size>
+            block   <address>   <size>  [<kind>  <name>  <frame>,<frame>,...]
+        Blocks belong to the span before them. Addresses and frames are hex, the rest only for sampled blocks.
+    */
+    void write_header(std::ostream& output);
+    void write_span(std::ostream& output, Span const& span);
+
+    /*
+        A dump being written to `path`. It goes to `path`.tmp and commit() renames it over `path`, so readers
+        never see half of one. Dropped without commit(), the temporary is removed.
+    */
+    class DumpFile {
+        public:
+        explicit DumpFile(std::string path);
+        DumpFile(DumpFile const&) = delete;
+        DumpFile& operator=(DumpFile const&) = delete;
+        ~DumpFile();
+
+        void write(Span const& span);
+        bool commit();
+
+        private:
+        std::string m_Path;
+        std::unique_ptr<std::ofstream> m_Output;
+        bool m_Committed = false;
+    };
+
+    // What a dump reads back as. Names are owned here, addresses are plain numbers of another process.
+    struct DumpedBlock {
+        uintptr_t address = 0;
+        size_t size = 0;
+        bool sampled = false;
+        Accounting::Kind kind = Accounting::Kind::Untagged;
+        std::string name;
+        std::vector<uintptr_t> frames;
+    };
+
+    struct DumpedSpan {
+        uintptr_t base = 0;
+        size_t size = 0;
+        std::vector<DumpedBlock> blocks;
+    };
+
+    // Empty if the input isn't a dump, or is one with a malformed line.
+    std::optional<std::vector<DumpedSpan>> read_dump(std::istream& input);
+}
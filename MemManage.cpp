@@ -0,0 +1,65 @@
+#include "MemManage.hpp"
+
+#include <iostream>
+
+#include "AutomaticMemory/Os.hpp"
+
+namespace AutomaticMemory {
+    namespace Errors {
+        base_error::base_error(std::string const& error_message, int error_code) : message(error_message), _error_code(error_code), exit(true) { 
+            std::cerr << "Error: \"" << message << "\"" << std::endl; 
+        }
+
+        base_error::~base_error() {
+            if (exit) {
+                std::exit(_error_code);
+            }
+        }
+    }
+
+    void place(void * memory, size_t size, Placement placement, AllocationFlags flags) {
+        bool const placed = size >= placement_threshold and placement != Placement::Local and Os::numa_nodes() > 1;
+        if (placed and placement == Placement::Interleave) {
+            // Best effort, a kernel without NUMA support leaves the pages local.
+            Os::interleave(memory, size);
+        }
+        else if (placed) {
+            Os::first_touch(memory, size);
+        }
+        // First touch faulted everything in already.
+        if (has(flags, AllocationFlags::Prefault) and not (placed and placement == Placement::FirstTouch)) {
+            Os::prefault(memory, size);
+        }
+    }
+
+    namespace {
+        constinit thread_local HeapScope * t_Scope = nullptr;
+    }
+
+    HeapScope::HeapScope(HeapHandle heap) : m_Heap{heap}, m_Previous{t_Scope} {
+        t_Scope = this;
+    }
+
+    HeapScope::~HeapScope() {
+        t_Scope = m_Previous;
+    }
+
+    HeapHandle current_heap() {
+        return t_Scope != nullptr ? t_Scope->heap() : HeapHandle{};
+    }
+
+    template class BasicHeap<>;
+
+    namespace {
+        // Holds the global heap without ever running its destructor.
+        union Immortal {
+            constexpr Immortal() : heap{} {}
+            ~Immortal() {}
+            Heap heap;
+        };
+
+        constinit Immortal immortal;
+    }
+
+    constinit Heap& heap = immortal.heap;
+}
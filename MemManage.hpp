@@ -2,9 +2,8 @@
 
 #include <cstddef>
 #include <cstdlib>
-#include <cstring>
 #include <exception>
-#include <iostream>
+#include <iosfwd>
 #include <list>
 #include <new>
 #include <type_traits>
@@ -13,6 +12,26 @@
 #include <algorithm>
 #include <string>
 #include <limits>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <unordered_map>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+#include "AutomaticMemory/Accounting.hpp"
+#include "AutomaticMemory/ArenaBackend.hpp"
+#include "AutomaticMemory/BuddyBackend.hpp"
+#include "AutomaticMemory/Files.hpp"
+#include "AutomaticMemory/Metrics.hpp"
+#include "AutomaticMemory/Parallel.hpp"
+#include "AutomaticMemory/Pressure.hpp"
+#include "AutomaticMemory/Prewarm.hpp"
+#include "AutomaticMemory/SegmentBackend.hpp"
+#include "AutomaticMemory/SlabBackend.hpp"
+#include "AutomaticMemory/TlsfBackend.hpp"
+#include "AutomaticMemory/Walk.hpp"
 
 /* 
     This namespace provides passive automatic memory management
@@ -20,7 +39,10 @@
     objects.
 */
 namespace AutomaticMemory {
-    class Heap;
+    template<typename Backend_, typename Threading_, typename Stats_, typename Error_, typename Construction_>
+    class BasicHeap;
+
+    class Interposer;
 
     namespace Errors {
         class base_error {
@@ -30,18 +52,13 @@ namespace AutomaticMemory {
             base_error(base_error&& other) : message(other.message), _error_code(other._error_code), exit(other.exit) {
                 other.dont_exit();
             }
-            base_error(std::string const& error_message, int error_code = -1) : message(error_message), _error_code(error_code), exit(true) { 
-                std::cerr << "Error: \"" << message << "\"" << std::endl; 
-            }
-            ~base_error() {
-                if (exit) {
-                    exits_on_error = true;
-                    std::exit(_error_code);
-                }
-            }
+            // Reports the error right away. Defined in MemManage.cpp, so this header doesn't need <iostream>.
+            base_error(std::string const& error_message, int error_code = -1);
+            ~base_error();
             base_error& operator=(base_error&& other) {
                 message = std::move(other.message);
                 _error_code = std::move(other._error_code);
+                exit = other.exit;
                 other.dont_exit();
                 return *this;
             }
@@ -58,9 +75,6 @@ namespace AutomaticMemory {
             std::string message{};
             int _error_code = -1; 
             mutable bool exit = false;
-            private:
-            friend class AutomaticMemory::Heap;
-            inline static bool exits_on_error = false; 
         };
 
         class BadConstruct : public base_error {
@@ -77,7 +91,225 @@ namespace AutomaticMemory {
             IndexOutOfBounds(IndexOutOfBounds&& other) : base_error(other.message, other._error_code) { other.dont_exit(); }
         };
 
-        
+        class OutOfMemory : public base_error {
+            public: 
+            OutOfMemory() : base_error("Heap is out of memory", -4) {}
+            OutOfMemory(std::string const& message) : base_error(message, -4) {}
+            OutOfMemory(OutOfMemory&& other) : base_error(other.message, other._error_code) { other.dont_exit(); }
+        };
+
+        class InvalidFree : public base_error {
+            public: 
+            InvalidFree() : base_error("Freed memory doesn't belong to this heap", -5) {}
+            InvalidFree(std::string const& message) : base_error(message, -5) {}
+            InvalidFree(InvalidFree&& other) : base_error(other.message, other._error_code) { other.dont_exit(); }
+        };
+
+        class IoError : public base_error {
+            public: 
+            IoError() : base_error("Couldn't read the file", -6) {}
+            IoError(std::string const& message) : base_error(message, -6) {}
+            IoError(IoError&& other) : base_error(other.message, other._error_code) { other.dont_exit(); }
+        };
+    }
+
+    /*
+        Policies for BasicHeap. Each one is picked at compile time, so the ones that aren't
+        needed cost nothing: a single threaded heap has no lock, a heap without stats has no
+        counters.
+    */
+    namespace Policies {
+        /*
+            Threading policies. The heap holds one of these and locks it around every backend call.
+        */
+        struct SingleThreaded {
+            void lock() {}
+            void unlock() {}
+        };
+
+        struct Locked {
+            void lock() { m_Mutex.lock(); }
+            void unlock() { m_Mutex.unlock(); }
+            private:
+            std::mutex m_Mutex;
+        };
+
+        /*
+            Stats policies. Counters are only touched under the heap's lock, so they don't need to be atomic.
+        */
+        struct NoStats {
+            void on_allocate(size_t) {}
+            void on_free(size_t) {}
+            void reset() {}
+            size_t in_use() const { return 0; }
+            size_t peak() const { return 0; }
+            size_t allocations() const { return 0; }
+            size_t frees() const { return 0; }
+        };
+
+        struct BasicStats {
+            void on_allocate(size_t size) {
+                memory_in_use += size;
+                peak_in_use = std::max(peak_in_use, memory_in_use);
+                ++allocation_count;
+            }
+            void on_free(size_t size) {
+                memory_in_use -= size;
+                ++free_count;
+            }
+            void reset() { memory_in_use = 0; }
+            size_t in_use() const { return memory_in_use; }
+            size_t peak() const { return peak_in_use; }
+            size_t allocations() const { return allocation_count; }
+            size_t frees() const { return free_count; }
+            private:
+            size_t memory_in_use = 0;
+            size_t peak_in_use = 0;
+            size_t allocation_count = 0;
+            size_t free_count = 0;
+        };
+
+        /*
+            BasicStats, plus every allocation charged to its type or tag in Accounting, see Accounting.hpp.
+            Raw allocations that don't know either (the interposer, allocate_aligned) are charged as untagged.
+            About every SampleEvery_ allocated bytes, the allocation crossing the mark is sampled: its key and
+            call stack are kept until it's freed, and BasicHeap::walk() reports them. 0 turns sampling off.
+            What's still live when the heap is reset by free_all() or destroyed is credited back then, so an
+            arena that's reset every request doesn't leave its allocations charged for good.
+        */
+        template<size_t SampleEvery_ = (size_t{512} << 10)>
+        struct BasicAccountedStats : BasicStats {
+            BasicAccountedStats() = default;
+            BasicAccountedStats(BasicAccountedStats const&) = delete;
+            BasicAccountedStats& operator=(BasicAccountedStats const&) = delete;
+            ~BasicAccountedStats() {
+                credit_live();
+            }
+
+            void on_allocate(void * memory, size_t size, Accounting::Key key) {
+                BasicStats::on_allocate(size);
+                Accounting::charge(key, size);
+                Live& live = m_Live[key.name.data()];
+                live.key = key;
+                live.bytes += size;
+                ++live.count;
+                if constexpr (SampleEvery_ > 0) {
+                    if (size < m_UntilSample) {
+                        m_UntilSample -= size;
+                        return;
+                    }
+                    m_UntilSample = SampleEvery_;
+                    Walk::Sample& sample = m_Samples[memory];
+                    sample.key = key;
+                    sample.depth = Walk::capture(sample.frames);
+                }
+            }
+            void on_free(void * memory, size_t size, Accounting::Key key) {
+                BasicStats::on_free(size);
+                Accounting::credit(key, size);
+                Live& live = m_Live[key.name.data()];
+                live.key = key;
+                live.bytes -= size;
+                --live.count;
+                if constexpr (SampleEvery_ > 0) {
+                    if (not m_Samples.empty()) {
+                        m_Samples.erase(memory);
+                    }
+                }
+            }
+            void reset() {
+                BasicStats::reset();
+                credit_live();
+                m_Samples.clear();
+            }
+            std::optional<Walk::Sample> sample_of(void * memory) const {
+                auto const sample = m_Samples.find(memory);
+                return sample != m_Samples.end() ? std::optional{sample->second} : std::nullopt;
+            }
+            private:
+            // What this heap has charged and not credited yet, per key. Keyed like Accounting, by the name's address.
+            struct Live {
+                Accounting::Key key;
+                size_t bytes = 0;
+                size_t count = 0;
+            };
+
+            void credit_live() {
+                for (auto const& [name, live] : m_Live) {
+                    if (live.count > 0) {
+                        Accounting::credit(live.key, live.bytes, live.count);
+                    }
+                }
+                m_Live.clear();
+            }
+
+            size_t m_UntilSample = SampleEvery_;
+            std::unordered_map<void*, Walk::Sample> m_Samples;
+            std::unordered_map<char const*, Live> m_Live;
+        };
+
+        using AccountedStats = BasicAccountedStats<>;
+
+        /*
+            Base_ (any of the stats policies above), plus how long allocate and free take, lock included,
+            in a Metrics::Histogram each. Costs two clock reads per call, so it's a separate policy.
+        */
+        template<typename Base_ = BasicStats>
+        struct Timed : Base_ {
+            void on_allocate_time(uint64_t ns) { m_AllocateLatency.record(ns); }
+            void on_free_time(uint64_t ns) { m_FreeLatency.record(ns); }
+            Metrics::Histogram const& allocate_latency() const { return m_AllocateLatency; }
+            Metrics::Histogram const& free_latency() const { return m_FreeLatency; }
+            private:
+            Metrics::Histogram m_AllocateLatency;
+            Metrics::Histogram m_FreeLatency;
+        };
+
+        /*
+            Error policies. Decide what happens when the backend can't serve an allocation, or
+            when memory that doesn't belong to the heap is freed.
+            ThrowOnError:   throws std::bad_alloc, same as std::allocator would.
+            ExitOnError:    reports the error and exits, like every other error in this namespace.
+            NullOnError:    returns nullptr and ignores bad frees, for callers that can't take exceptions.
+        */
+        struct ThrowOnError {
+            static void * out_of_memory(size_t) { throw std::bad_alloc{}; }
+            static void invalid_free(void *) { throw std::bad_alloc{}; }
+        };
+
+        struct ExitOnError {
+            static void * out_of_memory(size_t size) {
+                Errors::OutOfMemory{"Heap is out of memory, couldn't allocate " + std::to_string(size) + " bytes"};
+                return nullptr;
+            }
+            static void invalid_free(void *) {
+                Errors::InvalidFree{};
+            }
+        };
+
+        struct NullOnError {
+            static void * out_of_memory(size_t) { return nullptr; }
+            static void invalid_free(void *) {}
+        };
+
+        /*
+            Construction policies. Decide how allocate_constructed_n constructs an array and how its Pointer
+            destroys it again.
+            SerialConstruction:     one element after the other on the calling thread.
+            ParallelConstruction:   arrays of at least Threshold_ elements are split across Threads_ threads (every core
+                                    by default), both ways. Constructors and destructors of such types have to be
+                                    safe to run concurrently on different elements.
+        */
+        struct SerialConstruction {
+            static constexpr size_t threshold = std::numeric_limits<size_t>::max();
+            static constexpr size_t threads = 1;
+        };
+
+        template<size_t Threshold_ = (size_t{1} << 20), size_t Threads_ = 0>
+        struct ParallelConstruction {
+            static constexpr size_t threshold = Threshold_;
+            static constexpr size_t threads = Threads_;
+        };
     }
 
     /* 
@@ -120,7 +352,7 @@ namespace AutomaticMemory {
         // Default initializer. This class should only be constructed with a pointer or moved.
         base_pointer(T_ * pointer) : m_Ptr{pointer} {}
         // Default move constructor. 
-        base_pointer(T_*&& pointer, bool&& freed) : m_Ptr(pointer), freed(freed) {}
+        base_pointer(T_*&& pointer, bool&& freed) : freed(freed), m_Ptr(pointer) {}
         bool freed = false; 
         T_ * m_Ptr;
         private:
@@ -144,9 +376,48 @@ namespace AutomaticMemory {
         Megabyte = 1000000,
         Gigabyte = 1000000000,
     }; 
+
+    /*
+        Where the pages of a large allocation end up on a machine with more than one NUMA node.
+        Local:      wherever the OS puts them, usually the node of the thread that touches them first.
+        Interleave: round robin over every node (mbind), for arrays every core reads.
+        FirstTouch: one slice per node, touched by a thread running on that node before construction.
+        Only allocations of at least placement_threshold bytes are placed, smaller ones share pages with
+        other allocations. On a single node machine every placement is Local.
+    */
+    enum class Placement {
+        Local,
+        Interleave,
+        FirstTouch,
+    };
+
+    inline constexpr size_t placement_threshold = size_t{2} << 20;
+
+    /*
+        Per allocation requests, combined with |.
+        Prefault: fault every whole page of the block in right away (MADV_POPULATE_WRITE), so the first
+                  touch on a latency critical path doesn't. For whole heaps see the backends' populate
+                  and prewarm options instead.
+    */
+    enum class AllocationFlags : unsigned {
+        None     = 0,
+        Prefault = 1 << 0,
+    };
+
+    constexpr AllocationFlags operator|(AllocationFlags left, AllocationFlags right) {
+        return static_cast<AllocationFlags>(static_cast<unsigned>(left) | static_cast<unsigned>(right));
+    }
+
+    constexpr bool has(AllocationFlags flags, AllocationFlags flag) {
+        return (static_cast<unsigned>(flags) & static_cast<unsigned>(flag)) != 0;
+    }
+
+    // Applies placement, then flags, to [memory, memory + size). Defined in MemManage.cpp.
+    void place(void * memory, size_t size, Placement placement, AllocationFlags flags = AllocationFlags::None);
     
     template<typename T_>
     class Allocator;
+    class HeapHandle;
 
     /*
         Global heap class. 
@@ -164,43 +435,87 @@ namespace AutomaticMemory {
         overflow, check compiler specifications) The main memory management is provided by standard library since the Segment 
         is a fancy wrapper for std::vector<unsigned char> and Heap is a fancy wrapper and manager for std::vector<Segment>.
         So it's as much memory safe as std::vector.   
-    */
 
-    class Heap {
+        That is the default backend (Backends::Segments). BasicHeap takes the backend and the rest of its
+        behaviour as policies, all of them resolved at compile time:
+            Backend_    Where raw memory comes from. Backends::Segments, Backends::Tlsf, Backends::Buddy, Backends::Slab
+                        or Backends::Arena.
+            Threading_  Policies::SingleThreaded (no locking at all) or Policies::Locked.
+            Stats_      Policies::BasicStats, Policies::AccountedStats, Policies::Timed<...> or Policies::NoStats.
+            Error_      Policies::ThrowOnError, Policies::ExitOnError or Policies::NullOnError.
+            Construction_ Policies::SerialConstruction or Policies::ParallelConstruction<threshold>.
+        Heap is the default combination, TlsfHeap, BuddyHeap, SlabHeap and ArenaHeap swap only the backend.
+    */
+    template<typename Backend_ = Backends::Segments,
+             typename Threading_ = Policies::SingleThreaded,
+             typename Stats_ = Policies::BasicStats,
+             typename Error_ = Policies::ThrowOnError,
+             typename Construction_ = Policies::SerialConstruction>
+    class BasicHeap {
     private:
-        /* Segment
-            This class represents a memory segment. Each segment is a memory space.
-            std::vector<unsigned char> is the holder for raw memory. 
-        */
-        struct Segment {
-            Segment() : size(0) {}
-            Segment(size_t size) : size{size} { m_Memory.reserve(size); }
-            void reserve(size_t const& size) { m_Memory.reserve(size);  this->size = size; }
-            void resize(size_t const& size) { m_Memory.resize(size);  this->size = size; }
-            void * data() {
-                return static_cast<void*>(m_Memory.data());
-            }
-            bool operator==(Segment const& other) const { return m_Memory == other.m_Memory and size == other.size; }
-            auto begin() { return m_Memory.begin(); }
-            auto end() { return m_Memory.end(); }
-            std::vector<unsigned char> m_Memory;
-            size_t size;
-        };
         /* 
             Low level allocation.
-            We create a segment in the segments vector with a provided size.  As the segment gets constructed,
-            it reserves the requested memory size using std::vector<unsigned char>::reserve();
-            Returns reference to allocated segment. 
+            Asks the backend for `size` bytes of raw memory. Backends throw std::bad_alloc when they can't serve it,
+            which is handed over to the error policy.
         */
-        Segment& allocate(size_t size) {
-            memory_in_use += size;
-            auto& segment = m_Segments.emplace_back(Segment{size});
-            return segment;
+        void * allocate(size_t size, Accounting::Key key = {}) {
+            auto const started = start_timer();
+            std::lock_guard<Threading_> lock{m_Threading};
+            void * memory;
+            try {
+                memory = m_Backend.allocate(size);
+            } catch (std::bad_alloc const&) {
+                return Error_::out_of_memory(size);
+            }
+            on_allocate(memory, size, key);
+            if constexpr (timed) {
+                m_Stats.on_allocate_time(elapsed(started));
+            }
+            return memory;
+        }
+
+        // Alignment every backend gives any block, allocate_aligned() only goes to the backend for more.
+        static constexpr size_t guaranteed_alignment = 16;
+
+        // Latencies are only measured for Policies::Timed, everything else doesn't read the clock at all.
+        static constexpr bool timed = requires (Stats_& stats) { stats.on_allocate_time(uint64_t{}); };
+
+        static std::chrono::steady_clock::time_point start_timer() {
+            if constexpr (timed) {
+                return std::chrono::steady_clock::now();
+            } else {
+                return {};
+            }
+        }
+
+        static uint64_t elapsed(std::chrono::steady_clock::time_point started) {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+        }
+
+        // Stats policies that account per key get the block and its key, the others only the size.
+        void on_allocate(void * memory, size_t size, Accounting::Key key) {
+            if constexpr (requires { m_Stats.on_allocate(memory, size, key); }) {
+                m_Stats.on_allocate(memory, size, key);
+            } else {
+                m_Stats.on_allocate(size);
+            }
         }
 
-        std::vector<Segment> m_Segments;
-        size_t memory_in_use; 
+        void on_free(void * memory, size_t size, Accounting::Key key) {
+            if constexpr (requires { m_Stats.on_free(memory, size, key); }) {
+                m_Stats.on_free(memory, size, key);
+            } else {
+                m_Stats.on_free(size);
+            }
+        }
+
+        Backend_ m_Backend;
+        [[no_unique_address]] Threading_ m_Threading;
+        [[no_unique_address]] Stats_ m_Stats;
     public:
+        using backend_type = Backend_;
+        using threading_type = Threading_;
+
         /*
             Heap::Pointer class template. 
             This class template provides RAII for safe pointer handling. When a pointer reaches it's end of scope,
@@ -220,11 +535,11 @@ namespace AutomaticMemory {
             
             Pointer() = delete;
             Pointer(Pointer const& other) = delete;
-            Pointer(Pointer&& other) : memsegment(other.memsegment), owner(std::move(other.owner)), base_type{std::move(other.m_Ptr), std::move(other.freed)} { other.moved = true; other.error.dont_exit(); }
+            Pointer(Pointer&& other) : base_type{std::move(other.m_Ptr), std::move(other.freed)}, size(other.size), owner(std::move(other.owner)), error(std::move(other.error)), array_size(other.array_size), sized(other.sized) { other.moved = true; other.error.dont_exit(); }
 
             template<bool _array = array>
             typename std::enable_if<_array, T_&>::type operator[](size_t index) {
-                if (index < 0 or index > array_size) {
+                if (index >= array_size) {
                     SetError(std::move(Errors::IndexOutOfBounds{}));
                 }
                 return *(base_type::m_Ptr + index); 
@@ -236,72 +551,109 @@ namespace AutomaticMemory {
 
             private:
             friend class base_pointer<T_, Pointer>;
-            friend class Heap; 
+            friend class BasicHeap; 
             
-            Pointer(T_ * pointer, Heap * owner, Segment& memsegment) : base_type{pointer}, owner{owner}, memsegment(memsegment) {}
+            Pointer(T_ * pointer, BasicHeap * owner, size_t size) : base_type{pointer}, size(size), owner{owner} {}
 
-            Segment& memsegment;
-            Heap * owner;
+            // Size of the allocation in bytes.
+            size_t size;
+            BasicHeap * owner;
             Errors::base_error error;
-            size_t array_size; 
+            size_t array_size = 1; 
             bool moved = false;
+            // Freed with free_sized(), unless the block came from an aligned allocation.
+            bool sized = true;
 
             template<bool _array = array>
-            std::enable_if_t<_array, Pointer> SetSize(size_t size) {
+            std::enable_if_t<_array, Pointer&> SetSize(size_t size) {
                 array_size = size;
                 return *this;
             } 
 
             Pointer& SetError(Errors::base_error&& error) {
-                error = std::move(error);
+                this->error = std::move(error);
                 return *this;
             }
 
             void free_impl() {
-                if (moved) { return; }
-                if constexpr (array) {
-                    for (size_t i = 0; i < memsegment.size / sizeof(T_); ++i) {
-                        (base_type::m_Ptr + i)->~T_();
-                    }
+                if (moved or base_type::m_Ptr == nullptr) { return; }
+                if constexpr (std::is_trivially_destructible_v<T_>) {
+                    // Nothing to destroy.
+                } else if constexpr (array) {
+                    destroy_n(base_type::m_Ptr, array_size);
                 } else {
                     base_type::m_Ptr->~T_();
                 }
-                owner->free(*this);
+                if (sized) {
+                    owner->free_sized(base_type::m_Ptr, size, Accounting::type_key<T_>());
+                } else {
+                    owner->free(base_type::m_Ptr, size, Accounting::type_key<T_>());
+                }
             }
         };
 
         
         
-        Heap() { setatexit(); }; 
+        /*
+            Construction only sets up bookkeeping, backends get their memory on the first allocation
+            (Tlsf with Options::lazy). That keeps it constexpr, so a heap can be constinit.
+        */
+        constexpr BasicHeap() = default; 
+        /*
+            Constructs the backend from the given arguments, e.g. TlsfHeap{Backends::Tlsf::Options{.pool_size = ...}}.
+        */
+        template<typename... BackendArgs>
+        constexpr explicit BasicHeap(BackendArgs&&... args) : m_Backend{std::forward<BackendArgs>(args)...} {}
+        BasicHeap(BasicHeap const&) = delete;
+        BasicHeap& operator=(BasicHeap const&) = delete;
 
         /*
             Allocates x amount of objects on the memory.
             Allocation gets the size of type and multiplies it with count of objects, then reserves the exact size on the memory. 
             When reserving is complete, reserved Segment will be allocated with default constructor of the type. If default constructor
             is not available or no constructor parameters are supplied, build will fail.
+            Every element is constructed from the same arguments, so they are passed as lvalues and never moved from.
+            If a constructor throws, the Pointer holds BadConstruct and only the elements constructed before it, in order.
+            Arrays above the Construction_ policy's threshold are constructed on every core.
         */
         template<typename T_, typename... ConstructorArgs>
         Pointer<T_, true> allocate_constructed_n(size_t count, ConstructorArgs&&... args) {
-            Segment& allocated = allocate(sizeof(T_) * count); 
-            T_ * f_Ptr = static_cast<T_*>(allocated.data());
-            try {
-                if constexpr (sizeof...(ConstructorArgs) > 0) {
-                    for (int i = 0; i < count; i++) {
-                        new(f_Ptr + i) T_(std::forward<ConstructorArgs>(args)...); 
-                    }
-                }
-                else if constexpr (std::is_default_constructible_v<T_>) {
-                    for(int i = 0; i < count; i++) {
-                        new(f_Ptr + i) T_{};
-                    }
-                }
-                static_assert(std::is_default_constructible_v<T_> or sizeof...(ConstructorArgs) > 0, "If type is not default constructible, you have to give constructor parameters!");
+            return allocate_constructed_n<T_>(Placement::Local, AllocationFlags::None, count, std::forward<ConstructorArgs>(args)...);
+        }
+        template<typename T_, typename... ConstructorArgs>
+        Pointer<T_, true> allocate_constructed_n(Placement placement, size_t count, ConstructorArgs&&... args) {
+            return allocate_constructed_n<T_>(placement, AllocationFlags::None, count, std::forward<ConstructorArgs>(args)...);
+        }
+        template<typename T_, typename... ConstructorArgs>
+        Pointer<T_, true> allocate_constructed_n(AllocationFlags flags, size_t count, ConstructorArgs&&... args) {
+            return allocate_constructed_n<T_>(Placement::Local, flags, count, std::forward<ConstructorArgs>(args)...);
+        }
+        /*
+            Same as above, but the pages are placed on the NUMA nodes as asked, and the flags applied,
+            before anything is constructed.
+        */
+        template<typename T_, typename... ConstructorArgs>
+        Pointer<T_, true> allocate_constructed_n(Placement placement, AllocationFlags flags, size_t count, ConstructorArgs&&... args) {
+            size_t const size = sizeof(T_) * count;
+            T_ * f_Ptr = static_cast<T_*>(allocate(size, Accounting::type_key<T_>()));
+            if (f_Ptr == nullptr) {
+                return std::move(Pointer<T_, true>{f_Ptr, this, size}.SetSize(count).SetError(std::move(Errors::OutOfMemory{})));
             }
-            catch(std::exception const& e) {
-                return Pointer<T_, true>{f_Ptr, this, allocated}.SetSize(count).SetError(std::move(Errors::BadConstruct{"Exception while constructing, construction stopped!\n  What: " + std::string(e.what())}));
+            place(f_Ptr, size, placement, flags);
+            static_assert(std::is_default_constructible_v<T_> or sizeof...(ConstructorArgs) > 0, "If type is not default constructible, you have to give constructor parameters!");
+            Construction failure;
+            size_t const constructed = construct_n(f_Ptr, count, failure, args...);
+            if (failure.unknown) {
+                // Not something BadConstruct can describe, hand it to the caller as it is.
+                destroy_n(f_Ptr, constructed);
+                free(f_Ptr, size, Accounting::type_key<T_>());
+                std::rethrow_exception(failure.unknown);
+            }
+            if (constructed < count) {
+                return std::move(Pointer<T_, true>{f_Ptr, this, size}.SetSize(constructed).SetError(std::move(Errors::BadConstruct{"Exception while constructing, construction stopped!\n  What: " + failure.what})));
             }
 
-            return Pointer<T_, true>{f_Ptr, this, allocated}.SetSize(count); 
+            return std::move(Pointer<T_, true>{f_Ptr, this, size}.SetSize(count)); 
         }
 
         /* 
@@ -312,8 +664,10 @@ namespace AutomaticMemory {
         */
         template<typename T_, typename... ConstructorArgs>
         Pointer<T_, false> allocate_constructed(ConstructorArgs&&... args) {
-            Segment& allocated = allocate(sizeof(T_)); 
-            T_ * f_Ptr = static_cast<T_*>(allocated.data());
+            T_ * f_Ptr = static_cast<T_*>(allocate(sizeof(T_), Accounting::type_key<T_>()));
+            if (f_Ptr == nullptr) {
+                return std::move(Pointer<T_, false>{f_Ptr, this, sizeof(T_)}.SetError(std::move(Errors::OutOfMemory{})));
+            }
             try {
                 if constexpr (sizeof...(ConstructorArgs) > 0) {
                     new(f_Ptr) T_{std::forward<ConstructorArgs>(args)...}; 
@@ -323,56 +677,509 @@ namespace AutomaticMemory {
                 }
                 static_assert(std::is_default_constructible_v<T_> or sizeof...(ConstructorArgs) > 0, "If type is not default constructible, you have to give constructor parameters!");
             } catch(std::exception const& e) {
-                return std::move(Pointer<T_, false>{f_Ptr, this, allocated}.SetError(std::move(Errors::BadConstruct{"Exception while constructing, construction stopped!\n  What: " + std::string(e.what())})));
+                return std::move(Pointer<T_, false>{f_Ptr, this, sizeof(T_)}.SetError(std::move(Errors::BadConstruct{"Exception while constructing, construction stopped!\n  What: " + std::string(e.what())})));
+            }
+            return std::move(Pointer<T_, false>{f_Ptr, this, sizeof(T_)}); 
+        }
+        /*
+            Allocates room for `count` objects and leaves it as it is: no constructor runs and nothing is zeroed,
+            for buffers that are about to be overwritten anyway, e.g. by read_file(). So only for types that
+            don't need construction. `alignment` may go up to a page on backends that can align (not Arena),
+            the error policy gets the rest.
+        */
+        template<typename T_>
+        Pointer<T_, true> allocate_uninitialized_n(size_t count, size_t alignment = alignof(T_)) {
+            static_assert(std::is_trivially_default_constructible_v<T_> and std::is_trivially_destructible_v<T_>, "Only types that need no construction can be left uninitialized!");
+            size_t const size = sizeof(T_) * count;
+            T_ * f_Ptr = static_cast<T_*>(allocate_aligned(size, alignment, Accounting::type_key<T_>()));
+            if (f_Ptr == nullptr) {
+                return std::move(Pointer<T_, true>{f_Ptr, this, size}.SetSize(count).SetError(std::move(Errors::OutOfMemory{})));
+            }
+            Pointer<T_, true> result{f_Ptr, this, size};
+            // Small aligned blocks can sit in a bigger size class than their size says.
+            result.sized = alignment <= guaranteed_alignment;
+            return std::move(result.SetSize(count));
+        }
+
+        /*
+            Loads a whole file into a page aligned, uninitialized array of T_ with a single pass: the data is
+            read straight into it, with O_DIRECT past the page cache as well if `options.direct` says so. A
+            partial element at the end of the file is left out. When the file can't be opened or read, the
+            Pointer holds IoError and as many elements as were read.
+        */
+        template<typename T_ = char>
+        Pointer<T_, true> read_file(std::string const& path, Io::ReadOptions options = {}) {
+            size_t size = 0;
+            Io::File const file = Io::open_for_read(path, options, size);
+            if (not file) {
+                return std::move(Pointer<T_, true>{nullptr, this, 0}.SetSize(0).SetError(std::move(Errors::IoError{"Couldn't open " + path + ": " + std::strerror(errno)})));
+            }
+            size_t const count = size / sizeof(T_);
+            // Direct reads go in whole pages, the tail of the last one is allocated but not counted.
+            size_t const capacity = Os::round_to_pages(count * sizeof(T_));
+            auto buffer = allocate_uninitialized_n<T_>(capacity / sizeof(T_), Os::page_size());
+            if (buffer.m_Ptr == nullptr) {
+                return buffer;
             }
-            return std::move(Pointer<T_, false>{f_Ptr, this, allocated}); 
+            buffer.SetSize(count);
+            ptrdiff_t const read = Io::read_fully(file, buffer.m_Ptr, capacity, count * sizeof(T_));
+            if (read < 0 or static_cast<size_t>(read) < count * sizeof(T_)) {
+                std::string const reason = read < 0 ? std::strerror(errno) : "file got shorter";
+                buffer.SetSize(read < 0 ? 0 : static_cast<size_t>(read) / sizeof(T_));
+                return std::move(buffer.SetError(std::move(Errors::IoError{"Couldn't read " + path + ": " + reason})));
+            }
+            return buffer;
         }
+
+        /*
+            Maps a whole file copy-on-write and adopts the mapping as a block of this heap, so there's neither
+            a read nor a copy: pages come from the page cache as they're touched, and only pages that are
+            written get a private copy. Writes never reach the file. Freeing the Pointer unmaps it. Only for
+            backends that can adopt a mapping (Segments). IoError as in read_file().
+        */
+        template<typename T_ = char>
+        Pointer<T_, true> map_file(std::string const& path, Io::MapOptions options = {}) requires requires (Backend_& backend) { backend.adopt(nullptr, size_t{}); } {
+            static_assert(std::is_trivially_default_constructible_v<T_> and std::is_trivially_destructible_v<T_>, "Only types that need no construction can be mapped from a file!");
+            size_t size = 0;
+            Io::File const file = Io::open_for_read(path, {}, size);
+            size_t const count = size / sizeof(T_);
+            void * memory = file and count > 0 ? Io::map_private(file, size, options) : nullptr;
+            if (memory == nullptr) {
+                char const * reason = not file ? std::strerror(errno) : count == 0 ? "nothing to map" : std::strerror(errno);
+                return std::move(Pointer<T_, true>{nullptr, this, 0}.SetSize(0).SetError(std::move(Errors::IoError{"Couldn't map " + path + ": " + reason})));
+            }
+            {
+                std::lock_guard<Threading_> lock{m_Threading};
+                m_Backend.adopt(memory, size);
+                on_allocate(memory, size, Accounting::type_key<T_>());
+            }
+            return std::move(Pointer<T_, true>{static_cast<T_*>(memory), this, size}.SetSize(count));
+        }
+
         /*
             Returns the estimated used memory. 
             This is not an exact measurement. This basically calculates the supposed memory usage by holding the size of each allocation.
         */
         float used_memory(SizeTypes const& convert = SizeTypes::Kibibyte) {
-            return static_cast<float>(memory_in_use) / static_cast<size_t>(convert);
+            std::lock_guard<Threading_> lock{m_Threading};
+            return static_cast<float>(m_Stats.in_use()) / static_cast<size_t>(convert);
+        }
+
+        /*
+            Highest estimated usage seen so far. Always zero with Policies::NoStats.
+        */
+        float peak_memory(SizeTypes const& convert = SizeTypes::Kibibyte) {
+            std::lock_guard<Threading_> lock{m_Threading};
+            return static_cast<float>(m_Stats.peak()) / static_cast<size_t>(convert);
+        }
+
+        /*
+            Sized free, what C++14 sized delete is for: frees `memory` that was allocated with exactly `size`
+            bytes. Backends that can tell from the size alone where the block lives (Slab, Buddy) put it
+            straight back without looking it up, the others free as usual. Pointer and Allocator free this way.
+            Only for plain allocations, not aligned ones, and the size has to be right: Slab checks the block
+            against the class the size says, Buddy only in debug builds (no NDEBUG), and a mismatch goes to the
+            error policy as an invalid free.
+        */
+        void free_sized(void * memory, size_t size, Accounting::Key key = {}) {
+            if constexpr (requires { m_Backend.free_sized(memory, size); }) {
+                auto const started = start_timer();
+                std::lock_guard<Threading_> lock{m_Threading};
+                if (not m_Backend.free_sized(memory, size)) {
+                    Error_::invalid_free(memory);
+                    return;
+                }
+                on_free(memory, size, key);
+                if constexpr (timed) {
+                    m_Stats.on_free_time(elapsed(started));
+                }
+            } else {
+                free(memory, size, key);
+            }
+        }
+
+        /*
+            Tells whether `memory` lives in this heap. For backends over a reserved range
+            (Buddy, or Tlsf and Arena with Options::reserve) this is a single range compare.
+        */
+        bool owns(void * memory) {
+            std::lock_guard<Threading_> lock{m_Threading};
+            return m_Backend.owns(memory);
+        }
+
+        /*
+            Gives back everything allocated from this heap at once, e.g. an ArenaHeap at the end of a request.
+            Whatever still points into the heap is dangling afterwards, and freeing it is a double free on
+            every backend but Arena, whose frees do nothing anyway.
+        */
+        void free_all() {
+            std::lock_guard<Threading_> lock{m_Threading};
+            m_Stats.reset();
+            m_Backend.free_all();
+        }
+
+        /*
+            Hands the free memory the backend keeps around back to the OS without unmapping it (Os::purge()),
+            e.g. from a Pressure::Monitor, which only watches Locked heaps. Touching it again faults fresh
+            zeroed pages in. Returns the bytes released, always 0 for backends that keep nothing (Segments).
+        */
+        size_t trim() {
+            std::lock_guard<Threading_> lock{m_Threading};
+            if constexpr (requires { m_Backend.purge(); }) {
+                return m_Backend.purge();
+            } else {
+                return 0;
+            }
+        }
+
+        /*
+            Calls visitor(Walk::Span const&) for every span of the backend with the blocks live in it, see Walk.hpp.
+            The heap is only locked while a part of the backend is copied, never while the visitor runs, so
+            other threads keep allocating and the visitor may allocate from this heap as well.
+        */
+        template<typename Visitor_>
+        void walk(Visitor_&& visitor) {
+            std::vector<Walk::Span> spans;
+            for (size_t part = 0;; ++part) {
+                spans.clear();
+                {
+                    std::lock_guard<Threading_> lock{m_Threading};
+                    if (not m_Backend.snapshot(part, spans)) {
+                        break;
+                    }
+                    if constexpr (requires (void * memory) { m_Stats.sample_of(memory); }) {
+                        for (Walk::Span& span : spans) {
+                            for (Walk::Block& block : span.blocks) {
+                                block.sample = m_Stats.sample_of(block.address);
+                            }
+                        }
+                    }
+                }
+                for (Walk::Span const& span : spans) {
+                    visitor(span);
+                }
+            }
+        }
+
+        /*
+            Writes a walk to `path` in the dump format (Walk.hpp), for tools/heap_analyze. The dump goes to
+            a temporary file first and is renamed over `path`, so readers never see half of one.
+        */
+        bool dump(std::string const& path) {
+            Walk::DumpFile file{path};
+            walk([&file](Walk::Span const& span) { file.write(span); });
+            return file.commit();
+        }
+
+        /*
+            Snapshot of this heap for Metrics::render(), labelled `name`. Reserved bytes and size class occupancy
+            are filled in by backends that know them, latencies with Policies::Timed. Only copies counters under
+            the lock, cheap enough to call every second.
+        */
+        Metrics::HeapMetrics metrics(std::string name) {
+            Metrics::HeapMetrics result;
+            result.name = std::move(name);
+            std::lock_guard<Threading_> lock{m_Threading};
+            result.live_bytes = m_Stats.in_use();
+            result.peak_bytes = m_Stats.peak();
+            result.allocations = m_Stats.allocations();
+            result.frees = m_Stats.frees();
+            if constexpr (requires { m_Backend.reserved(); }) {
+                result.reserved_bytes = m_Backend.reserved();
+            }
+            if constexpr (requires { m_Backend.occupancy(size_t{}); Backend_::size_classes::count; }) {
+                for (size_t index = 0; index < Backend_::size_classes::count; ++index) {
+                    result.size_classes.push_back(m_Backend.occupancy(index));
+                }
+            }
+            if constexpr (timed) {
+                result.allocate_latency = m_Stats.allocate_latency();
+                result.free_latency = m_Stats.free_latency();
+            }
+            return result;
         }
         
         private:
+        // What went wrong in construct_n. `unknown` is set for exceptions not derived from std::exception.
+        struct Construction {
+            std::string what;
+            std::exception_ptr unknown;
+        };
+
+        // Threads to split `count` elements over, never chunks of less than a few thousand elements.
+        static size_t chunks_for(size_t count) {
+            constexpr size_t min_chunk = 4096;
+            if (count < Construction_::threshold or count < 2 * min_chunk) {
+                return 1;
+            }
+            size_t const threads = Construction_::threads > 0 ? Construction_::threads : Parallel::hardware_threads();
+            return std::min(threads, count / min_chunk);
+        }
+
+        /*
+            Constructs `count` elements at `memory` and returns how many of them, from the front, are alive.
+            Less than `count` means a constructor threw. The failure is reported and whatever got constructed
+            past the returned prefix is destroyed again, so the memory always holds a valid, shorter array.
+            When split across threads, a failing chunk stops the others at their next element.
+        */
+        template<typename T_, typename... ConstructorArgs>
+        static size_t construct_n(T_ * memory, size_t count, Construction& failure, ConstructorArgs&... args) {
+            struct Chunk {
+                size_t begin = 0;
+                size_t constructed = 0;
+                bool threw = false;
+                std::string what;
+                std::exception_ptr unknown;
+            };
+            std::atomic<bool> stop{false};
+            auto const construct = [&](Chunk& own, size_t begin, size_t end) {
+                own.begin = begin;
+                size_t i = begin;
+                try {
+                    for (; i < end and not stop.load(std::memory_order_relaxed); ++i) {
+                        if constexpr (sizeof...(ConstructorArgs) > 0) {
+                            new(memory + i) T_(args...);
+                        } else {
+                            new(memory + i) T_{};
+                        }
+                    }
+                } catch (std::exception const& e) {
+                    own.threw = true;
+                    own.what = e.what();
+                    stop = true;
+                } catch (...) {
+                    own.threw = true;
+                    own.unknown = std::current_exception();
+                    stop = true;
+                }
+                own.constructed = i - begin;
+            };
+
+            size_t const chunks = chunks_for(count);
+            if (chunks == 1) {
+                Chunk only;
+                construct(only, 0, count);
+                failure.what = std::move(only.what);
+                failure.unknown = only.unknown;
+                return only.constructed;
+            }
+            std::vector<Chunk> state(chunks);
+            Parallel::for_chunks(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+                construct(state[chunk], begin, end);
+            });
+
+            if (not stop) {
+                return count;
+            }
+            // The first chunk that didn't finish ends the prefix, everything constructed after it goes.
+            size_t alive = count;
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                Chunk const& current = state[chunk];
+                size_t const end = chunk + 1 < chunks ? state[chunk + 1].begin : count;
+                if (alive == count and current.begin + current.constructed < end) {
+                    alive = current.begin + current.constructed;
+                } else if (alive != count) {
+                    destroy_n(memory + current.begin, current.constructed);
+                }
+                if (current.threw and failure.what.empty() and not failure.unknown) {
+                    failure.what = current.what;
+                    failure.unknown = current.unknown;
+                }
+            }
+            return alive;
+        }
+
+        // Destroys `count` elements at `memory`, on every core for big arrays if the construction policy says so.
+        template<typename T_>
+        static void destroy_n(T_ * memory, size_t count) {
+            if constexpr (not std::is_trivially_destructible_v<T_>) {
+                Parallel::for_chunks(count, chunks_for(count), [memory](size_t, size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        (memory + i)->~T_();
+                    }
+                });
+            }
+        }
+
         /*
             Internal free method. 
             When a pointer is ready to die, this method is called. Releases memory immediately.  
+            Memory that doesn't belong to the heap goes to the error policy.
         */
-        template<typename T_, bool array>
-        void free(Pointer<T_, array>& pointer) {
-            memory_in_use -= pointer.memsegment.size;
-            auto it = std::find(m_Segments.begin(), m_Segments.end(), pointer.memsegment);
-            if (it == m_Segments.end()) { return; }
-            m_Segments.erase(it);
-            // release back memory.
-            m_Segments.shrink_to_fit();
+        void free(void * memory, size_t size, Accounting::Key key = {}) {
+            auto const started = start_timer();
+            std::lock_guard<Threading_> lock{m_Threading};
+            if (not m_Backend.free(memory)) {
+                Error_::invalid_free(memory);
+                return;
+            }
+            on_free(memory, size, key);
+            if constexpr (timed) {
+                m_Stats.on_free_time(elapsed(started));
+            }
         }
+
         /*
-            Internal free method reserved for further implementations on different data structures
-            that this class can be used as the allocator. 
+            Aligned low level allocation, for alignments over what the backend guarantees anyway (16 bytes).
+            Backends that can't align (no allocate_aligned) go to the error policy for those.
         */
-        void free(std::vector<Segment>::iterator& segment) {
-            memory_in_use -= segment->size;
-            if (segment == m_Segments.end()) { return; }
-            m_Segments.erase(segment);
-            m_Segments.shrink_to_fit();
+        void * allocate_aligned(size_t size, size_t alignment, Accounting::Key key = {}) {
+            if (alignment <= guaranteed_alignment) {
+                return allocate(size, key);
+            }
+            std::lock_guard<Threading_> lock{m_Threading};
+            void * memory;
+            try {
+                if constexpr (requires { m_Backend.allocate_aligned(size, alignment); }) {
+                    memory = m_Backend.allocate_aligned(size, alignment);
+                } else {
+                    throw std::bad_alloc{};
+                }
+            } catch (std::bad_alloc const&) {
+                return Error_::out_of_memory(size);
+            }
+            on_allocate(memory, size, key);
+            return memory;
         }
 
-        void free_all() {
-            memory_in_use = 0; 
-            m_Segments.clear();
-            m_Segments.shrink_to_fit();
+        // Real size of the allocation behind `memory`, only for backends that know it.
+        size_t usable_size(void * memory) requires requires (Backend_& backend, void * pointer) { backend.usable_size(pointer); } {
+            std::lock_guard<Threading_> lock{m_Threading};
+            return m_Backend.usable_size(memory);
         }
 
-        void setatexit();
-
         template<typename T_>
         friend class Allocator; 
+        friend class HeapHandle;
+        friend class Interposer;
     };
+
+    using Heap = BasicHeap<>;
+    using TlsfHeap = BasicHeap<Backends::Tlsf>;
+    using BuddyHeap = BasicHeap<Backends::Buddy>;
+    using SlabHeap = BasicHeap<Backends::Slab>;
+    using ArenaHeap = BasicHeap<Backends::Arena>;
+
+    // The default heap is instantiated once, in MemManage.cpp. Other combinations are instantiated where they are used.
+    extern template class BasicHeap<>;
+
     
-    inline Heap heap;
+    /*
+        In the case of any errors, heap will not throw exceptions. Instead it will call
+        std::exit(). The reason behind this; I want to release memory to operating system no matter
+        what. If an exception happens during allocation, it'll be coming from
+        std::vector<unsigned char, std::allocator<unsigned char>>. Thus we can separate errors coming
+        from this system or any other part of the program.
+
+        But if an error coming from this structure you'll be handed a geterror. You might ignore this
+        method if you are sure what you do is not going to give any errors at all. If you don't use
+        this method and any error occured and don't request "don't exit", your program will exit at the
+        end of the pointers life time. Make sure to handle any errors occures.
+
+        The global heap is constant initialized: it's ready before any dynamic initializer in any translation
+        unit runs, and it maps nothing until the first allocation. It's also never destroyed, like
+        Interposer::heap(): globals of other translation units, e.g. AutomaticMemory::string, may be destroyed
+        after MemManage.cpp's statics and still free into it. The OS takes its memory back at exit, std::exit()
+        on error included. It's defined in MemManage.cpp.
+    */
+    extern constinit Heap& heap;
+
+    /*
+        Type erased reference to any BasicHeap, what Allocator and HeapScope hold on to.
+        Two pointers: the heap and a table of functions that know its type. Default constructed it's the global heap.
+    */
+    class HeapHandle {
+    public:
+        constexpr HeapHandle() : HeapHandle{heap} {}
+
+        // Constrained, so it doesn't hijack copying a non const HeapHandle.
+        template<typename Heap_> requires (not std::is_same_v<std::remove_cv_t<Heap_>, HeapHandle>)
+        constexpr explicit HeapHandle(Heap_& heap) : m_Heap{&heap}, m_Operations{&operations_for<Heap_>} {}
+
+        // Null if the heap is out of memory and its error policy lets it return.
+        void * allocate(size_t size, Accounting::Key key = {}) const {
+            return m_Operations->allocate(m_Heap, size, key);
+        }
+
+        // BasicHeap::allocate_aligned(), freed with free() like any other block.
+        void * allocate_aligned(size_t size, size_t alignment, Accounting::Key key = {}) const {
+            return m_Operations->allocate_aligned(m_Heap, size, alignment, key);
+        }
+
+        void free(void * memory, size_t size, Accounting::Key key = {}) const {
+            m_Operations->free(m_Heap, memory, size, key);
+        }
+
+        // BasicHeap::free_sized(), for memory from allocate() above with the same size.
+        void free_sized(void * memory, size_t size, Accounting::Key key = {}) const {
+            m_Operations->free_sized(m_Heap, memory, size, key);
+        }
+
+        bool owns(void * memory) const {
+            return m_Operations->owns(m_Heap, memory);
+        }
+
+        friend bool operator==(HeapHandle const& left, HeapHandle const& right) {
+            return left.m_Heap == right.m_Heap;
+        }
+
+    private:
+        struct Operations {
+            void * (*allocate)(void * heap, size_t size, Accounting::Key key);
+            void * (*allocate_aligned)(void * heap, size_t size, size_t alignment, Accounting::Key key);
+            void (*free)(void * heap, void * memory, size_t size, Accounting::Key key);
+            void (*free_sized)(void * heap, void * memory, size_t size, Accounting::Key key);
+            bool (*owns)(void * heap, void * memory);
+        };
+
+        template<typename Heap_>
+        static constexpr Operations operations_for{
+            [](void * heap, size_t size, Accounting::Key key) { return static_cast<Heap_*>(heap)->allocate(size, key); },
+            [](void * heap, size_t size, size_t alignment, Accounting::Key key) { return static_cast<Heap_*>(heap)->allocate_aligned(size, alignment, key); },
+            [](void * heap, void * memory, size_t size, Accounting::Key key) { static_cast<Heap_*>(heap)->free(memory, size, key); },
+            [](void * heap, void * memory, size_t size, Accounting::Key key) { static_cast<Heap_*>(heap)->free_sized(memory, size, key); },
+            [](void * heap, void * memory) { return static_cast<Heap_*>(heap)->owns(memory); },
+        };
+
+        void * m_Heap;
+        Operations const * m_Operations;
+    };
+
+    /*
+        Makes `heap` the current heap of this thread until the scope ends. Every Allocator constructed
+        meanwhile, so every AutomaticMemory::vector, string, list, ... and whatever third party code builds
+        from them, allocates from it instead of the global heap:
+
+            ArenaHeap arena;
+            {
+                HeapScope scope{arena};
+                handle_request();           // everything it allocates through Allocator comes from arena
+            }
+            arena.free_all();               // all gone in one go
+
+        An Allocator remembers its heap, so memory is always freed to the heap it came from, whatever scope
+        is current then. Containers built before the scope keep using their own heap inside it. Scopes nest,
+        and have to end in reverse order, which they do as locals. The heap has to outlive everything that
+        allocated from it.
+    */
+    class HeapScope {
+    public:
+        template<typename Heap_> requires (not std::is_same_v<std::remove_cv_t<Heap_>, HeapHandle>)
+        explicit HeapScope(Heap_& heap) : HeapScope{HeapHandle{heap}} {}
+        explicit HeapScope(HeapHandle heap);
+        HeapScope(HeapScope const&) = delete;
+        HeapScope& operator=(HeapScope const&) = delete;
+        ~HeapScope();
+
+        HeapHandle heap() const { return m_Heap; }
+
+    private:
+        HeapHandle m_Heap;
+        HeapScope * m_Previous;
+    };
+
+    // The heap of this thread's innermost HeapScope, the global heap outside of any. Defined in MemManage.cpp.
+    HeapHandle current_heap();
 
     /*
         This class is an interface class to replace C++'s std::allocator type to allocate strings, and new vectors and such stuff
@@ -383,36 +1190,54 @@ namespace AutomaticMemory {
     public:
         using value_type = T_;
 
-        Allocator() = default;
+        /*
+            Allocators compare equal when they allocate from the same heap, the placement only changes where
+            large blocks' pages go. Containers with allocators of different heaps move element by element.
+        */
+        using is_always_equal = std::false_type;
+
+        /*
+            Allocates from the current heap, see HeapScope. It's picked up here, once, so a container
+            keeps allocating from and freeing to the heap it was built with.
+        */
+        Allocator() : m_Heap{current_heap()} {}
+        explicit Allocator(HeapHandle heap) noexcept : m_Heap{heap} {}
+        /*
+            E.g. AutomaticMemory::vector<double> values{Allocator<double>{Placement::Interleave}};
+        */
+        explicit Allocator(Placement placement, AllocationFlags flags = AllocationFlags::None)
+            : m_Heap{current_heap()}, m_Placement{placement}, m_Flags{flags} {}
+        explicit Allocator(AllocationFlags flags) : m_Heap{current_heap()}, m_Flags{flags} {}
+        /*
+            Charges everything allocated through this allocator, and its rebound copies, to a subsystem tag
+            instead of the element type, for heaps with Policies::AccountedStats.
+            E.g. AutomaticMemory::string name{Allocator<char>{Accounting::tag("parser")}};
+        */
+        explicit Allocator(Accounting::Key key) : m_Heap{current_heap()}, m_Key{key} {}
 
+        // Tags survive rebinding, type keys follow the new type.
         template<typename U>
-        Allocator(const Allocator<U>&) noexcept {}
+        Allocator(const Allocator<U>& other) noexcept
+            : m_Heap{other.heap()}, m_Placement{other.placement()}, m_Flags{other.flags()},
+              m_Key{other.key().kind == Accounting::Kind::Tag ? other.key() : Accounting::type_key<T_>()} {}
 
         /*
             Allocates a memory and returns the address of the head of the allocated memory.
         */
         T_* allocate(std::size_t n) {
-            Heap::Segment& segment = heap.allocate(n * sizeof(T_));
-            T_* ptr = static_cast<T_*>(segment.data());
+            T_* ptr = static_cast<T_*>(m_Heap.allocate(n * sizeof(T_), m_Key));
+            if (ptr == nullptr) {
+                throw std::bad_alloc{};
+            }
+            place(ptr, n * sizeof(T_), m_Placement, m_Flags);
             return ptr;
         }
         /*
-            Deallocates a memory. Tries to find the address. If address doesn't belong to heap. It'll call
-            bad alloc.
+            Deallocates a memory. The container hands back the count it allocated, so the heap takes the sized
+            free path and doesn't have to look the block up (BasicHeap::free_sized()).
         */
         void deallocate(T_* p, std::size_t n) {
-            auto it = std::find_if(heap.m_Segments.begin(), heap.m_Segments.end(), [&](Heap::Segment& segment) {
-                if (static_cast<T_*>(segment.data()) == p) {
-                    return true;
-                }
-                return false;
-                });
-
-            if (it == heap.m_Segments.end()) {
-                throw std::bad_alloc{};
-            }
-
-            heap.free(it);
+            m_Heap.free_sized(p, n * sizeof(T_), m_Key);
         }
         /*
             Default max_size for allocators. std::vector uses std::allocator which uses this specific max_size
@@ -437,26 +1262,34 @@ namespace AutomaticMemory {
         void destroy(U* p) noexcept {
             p->~U();
         }
-    };
 
-    /*
-        In the case of any errors, heap will not throw exceptions. Instead it will call
-        std::exit(). The reason behind this; I want to release memory to operating system no matter
-        what. If an exception happens during allocation, it'll be coming from
-        std::vector<unsigned char, std::allocator<unsigned char>>. Thus we can separate errors coming
-        from this system or any other part of the program.
+        HeapHandle heap() const noexcept {
+            return m_Heap;
+        }
+
+        constexpr Placement placement() const noexcept {
+            return m_Placement;
+        }
+
+        constexpr AllocationFlags flags() const noexcept {
+            return m_Flags;
+        }
+
+        constexpr Accounting::Key key() const noexcept {
+            return m_Key;
+        }
+
+        template<typename U>
+        friend bool operator==(Allocator const& left, Allocator<U> const& right) noexcept {
+            return left.heap() == right.heap();
+        }
+    private:
+        HeapHandle m_Heap;
+        Placement m_Placement = Placement::Local;
+        AllocationFlags m_Flags = AllocationFlags::None;
+        Accounting::Key m_Key = Accounting::type_key<T_>();
+    };
 
-        But if an error coming from this structure you'll be handed a geterror. You might ignore this
-        method if you are sure what you do is not going to give any errors at all. If you don't use
-        this method and any error occured and don't request "don't exit", your program will exit at the
-        end of the pointers life time. Make sure to handle any errors occures.
-    */
-    inline void Heap::setatexit() {
-        std::atexit([]() {
-            if (Errors::base_error::exits_on_error)
-                heap.free_all();
-            });
-    }
     template<typename T_>
     using basic_string = std::basic_string<T_, std::char_traits<T_>, Allocator<T_>>; 
     template<typename T_>
@@ -0,0 +1,53 @@
+#include "Bench.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace Bench {
+    namespace {
+        size_t read_status_kib(char const* field) {
+            std::ifstream status{"/proc/self/status"};
+            std::string line;
+            size_t const length = std::strlen(field);
+            while (std::getline(status, line)) {
+                if (line.compare(0, length, field) == 0) {
+                    return std::strtoull(line.c_str() + length, nullptr, 10);
+                }
+            }
+            return 0;
+        }
+    }
+
+    size_t rss_kib() {
+        return read_status_kib("VmRSS:");
+    }
+
+    size_t peak_rss_kib() {
+        return read_status_kib("VmHWM:");
+    }
+
+    void reset_peak_rss() {
+        // "5" resets the peak RSS counter (Linux 4.0+). Harmless if it isn't writable.
+        std::ofstream clear_refs{"/proc/self/clear_refs"};
+        clear_refs << "5";
+    }
+
+    void report_latencies(Context& ctx, std::string const& prefix, std::vector<long long>& samples) {
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto const at = [&](double q) { return static_cast<double>(samples[static_cast<size_t>(q * (samples.size() - 1))]); };
+        long double sum = 0;
+        for (long long sample : samples) {
+            sum += sample;
+        }
+        ctx.metric(prefix + "_mean_ns", static_cast<double>(sum / samples.size()));
+        ctx.metric(prefix + "_p50_ns", at(0.5));
+        ctx.metric(prefix + "_p99_ns", at(0.99));
+        ctx.metric(prefix + "_p999_ns", at(0.999));
+        ctx.metric(prefix + "_max_ns", static_cast<double>(samples.back()));
+    }
+}
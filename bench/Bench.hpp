@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+    Minimal benchmark harness.
+    A case is a function taking a Context. It does its work `ctx.operations` times (scaled to
+    taste), says how many operations that came to through ctx.completed() and reports whatever
+    other metrics it wants through ctx.metric(). The harness runs every
+    case `repetitions` times, adds wall time and RSS around each run, and prints a table or
+    writes JSON that later runs can be compared against.
+
+        PASSIVEGC_BENCH(segments_small_churn) {
+            ...
+            ctx.completed(ops, seconds);
+        }
+
+    Scaling cases (PASSIVEGC_BENCH_SCALING) run once per thread count of --threads and use
+    ctx.threads threads. Their runs are named "case/tN".
+*/
+namespace Bench {
+    class Context {
+        public:
+        explicit Context(size_t operations, size_t threads = 1) : operations{operations}, threads{threads} {}
+
+        // Adds a metric to the current repetition. Reporting the same name again overwrites it.
+        void metric(std::string const& name, double value) {
+            m_Metrics[name] = value;
+        }
+
+        std::map<std::string, double> const& metrics() const {
+            return m_Metrics;
+        }
+
+        /*
+            The operations the case ran, all threads together, in `seconds` of its own timing. Sets ops_per_sec,
+            and the per operation counters are divided by it. Cases that don't call it count as `operations`
+            times `threads` operations over the wall time of the whole case, setup included.
+        */
+        void completed(size_t count, double seconds) {
+            m_Completed = count;
+            metric("ops_per_sec", static_cast<double>(count) / seconds);
+        }
+
+        size_t operations_completed() const {
+            return m_Completed.value_or(operations * threads);
+        }
+
+        // Scale of the run, set from the command line. Cases decide what one operation is.
+        size_t const operations;
+        // Threads a scaling case should use, always 1 for the others.
+        size_t const threads;
+
+        private:
+        std::map<std::string, double> m_Metrics;
+        std::optional<size_t> m_Completed;
+    };
+
+    using Function = void(*)(Context&);
+
+    struct Case {
+        std::string name;
+        Function function;
+        bool scaling = false;
+    };
+
+    inline std::vector<Case>& registry() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    struct Register {
+        Register(char const* name, Function function, bool scaling = false) {
+            registry().push_back(Case{name, function, scaling});
+        }
+    };
+
+    // Resident and peak resident set size of the process in KiB, read from /proc/self/status.
+    size_t rss_kib();
+    size_t peak_rss_kib();
+    // Resets the peak so the next peak_rss_kib() only covers what runs after this call.
+    void reset_peak_rss();
+
+    // Latency percentiles over a set of samples in nanoseconds. Sorts the samples.
+    void report_latencies(Context& ctx, std::string const& prefix, std::vector<long long>& samples);
+
+    using Clock = std::chrono::steady_clock;
+
+    inline double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+#define PASSIVEGC_BENCH_CONCAT_(a, b) a##b
+#define PASSIVEGC_BENCH_CONCAT(a, b) PASSIVEGC_BENCH_CONCAT_(a, b)
+#define PASSIVEGC_BENCH(name)                                                                   \
+    static void name(::Bench::Context& ctx);                                                    \
+    static ::Bench::Register PASSIVEGC_BENCH_CONCAT(register_, name){#name, &name};             \
+    static void name([[maybe_unused]] ::Bench::Context& ctx)
+#define PASSIVEGC_BENCH_SCALING(name)                                                           \
+    static void name(::Bench::Context& ctx);                                                    \
+    static ::Bench::Register PASSIVEGC_BENCH_CONCAT(register_, name){#name, &name, true};       \
+    static void name([[maybe_unused]] ::Bench::Context& ctx)
@@ -0,0 +1,124 @@
+#include "Counters.hpp"
+#include "Bench.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Bench {
+    namespace {
+        struct Event {
+            char const * name;
+            uint32_t type;
+            uint64_t config;
+        };
+
+        constexpr uint64_t cache_miss(uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+
+        constexpr Event events[] = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"l1d_misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+            {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"dtlb_misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_DTLB)},
+            {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        };
+
+        int open_event(Event const& event) {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = event.type;
+            attributes.config = event.config;
+            attributes.disabled = 1;
+            attributes.inherit = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+    }
+
+    PerfCounters::PerfCounters() {
+        for (Event const& event : events) {
+            m_Counters.push_back(Counter{event.name, open_event(event), 0});
+        }
+    }
+
+    PerfCounters::~PerfCounters() {
+        for (Counter const& counter : m_Counters) {
+            if (counter.fd >= 0) {
+                ::close(counter.fd);
+            }
+        }
+    }
+
+    void PerfCounters::start() {
+        for (Counter& counter : m_Counters) {
+            if (counter.fd >= 0) {
+                ::ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void PerfCounters::stop() {
+        for (Counter& counter : m_Counters) {
+            if (counter.fd < 0) {
+                continue;
+            }
+            ::ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+            // value, time enabled, time running.
+            uint64_t values[3] = {};
+            if (::read(counter.fd, values, sizeof(values)) != sizeof(values)) {
+                counter.value = 0;
+                continue;
+            }
+            counter.value = values[2] > 0 ? static_cast<double>(values[0]) * values[1] / values[2] : 0;
+        }
+    }
+
+    void PerfCounters::report(Context& ctx, double operations) const {
+        double cycles = 0, instructions = 0;
+        for (Counter const& counter : m_Counters) {
+            if (counter.fd < 0) {
+                continue;
+            }
+            ctx.metric(std::string{counter.name} + "_per_op", counter.value / operations);
+            if (std::strcmp(counter.name, "cycles") == 0) {
+                cycles = counter.value;
+            } else if (std::strcmp(counter.name, "instructions") == 0) {
+                instructions = counter.value;
+            }
+        }
+        if (cycles > 0 and instructions > 0) {
+            ctx.metric("ipc", instructions / cycles);
+        }
+    }
+
+    std::vector<std::string> PerfCounters::available() const {
+        std::vector<std::string> names;
+        for (Counter const& counter : m_Counters) {
+            if (counter.fd >= 0) {
+                names.emplace_back(counter.name);
+            }
+        }
+        return names;
+    }
+
+    std::vector<std::string> PerfCounters::missing() const {
+        std::vector<std::string> names;
+        for (Counter const& counter : m_Counters) {
+            if (counter.fd < 0) {
+                names.emplace_back(counter.name);
+            }
+        }
+        return names;
+    }
+}
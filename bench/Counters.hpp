@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Bench {
+    class Context;
+
+    /*
+        Hardware and software performance counters around one benchmark run, through perf_event_open.
+        Counts the calling thread and every thread it starts while counting, user space only, so it
+        works with the default perf_event_paranoid of 2. Counters the machine doesn't have (containers
+        and VMs often have none of the hardware ones) are left out, available() tells which are in.
+        When more counters are open than the PMU has slots, the kernel multiplexes them and the counts
+        are scaled up from the time they actually ran.
+    */
+    class PerfCounters {
+        public:
+        PerfCounters();
+        PerfCounters(PerfCounters const&) = delete;
+        PerfCounters& operator=(PerfCounters const&) = delete;
+        ~PerfCounters();
+
+        void start();
+        void stop();
+
+        /*
+            Reports every open counter as "<name>_per_op", counts divided by `operations`, plus "ipc" when
+            both cycles and instructions are there.
+        */
+        void report(Context& ctx, double operations) const;
+
+        // Names of the counters that could be opened.
+        std::vector<std::string> available() const;
+        // Names of the counters that couldn't.
+        std::vector<std::string> missing() const;
+
+        private:
+        struct Counter {
+            char const * name;
+            int fd;
+            double value;
+        };
+
+        std::vector<Counter> m_Counters;
+    };
+}
@@ -0,0 +1,185 @@
+#include "Results.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <istream>
+#include <iterator>
+#include <ostream>
+
+namespace Bench {
+    namespace {
+        /*
+            Just enough JSON for our own output: objects, arrays, strings without escapes
+            beyond \" and \\, and numbers. Anything else fails the parse.
+        */
+        class Parser {
+            public:
+            explicit Parser(std::string text) : m_Text{std::move(text)} {}
+
+            std::optional<Results> results() {
+                Results results;
+                bool ok = object([&](std::string const& key) {
+                    if (key == "operations") {
+                        double value;
+                        if (not number(value)) {
+                            return false;
+                        }
+                        results.operations = static_cast<size_t>(value);
+                        return true;
+                    }
+                    if (key == "benchmarks") {
+                        return array([&] { return run(results.runs.emplace_back()); });
+                    }
+                    return false;
+                });
+                if (not ok) {
+                    return std::nullopt;
+                }
+                return results;
+            }
+
+            private:
+            bool run(Run& run) {
+                return object([&](std::string const& key) {
+                    if (key == "name") {
+                        return string(run.name);
+                    }
+                    if (key == "repetitions") {
+                        return array([&] {
+                            auto& metrics = run.repetitions.emplace_back();
+                            return object([&](std::string const& metric) { return number(metrics[metric]); });
+                        });
+                    }
+                    return false;
+                });
+            }
+
+            template<typename Member_>
+            bool object(Member_ member) {
+                if (not consume('{')) {
+                    return false;
+                }
+                if (consume('}')) {
+                    return true;
+                }
+                do {
+                    std::string key;
+                    if (not string(key) or not consume(':') or not member(key)) {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume('}');
+            }
+
+            template<typename Element_>
+            bool array(Element_ element) {
+                if (not consume('[')) {
+                    return false;
+                }
+                if (consume(']')) {
+                    return true;
+                }
+                do {
+                    if (not element()) {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume(']');
+            }
+
+            bool string(std::string& out) {
+                if (not consume('"')) {
+                    return false;
+                }
+                out.clear();
+                while (m_Position < m_Text.size() and m_Text[m_Position] != '"') {
+                    if (m_Text[m_Position] == '\\' and m_Position + 1 < m_Text.size()) {
+                        ++m_Position;
+                    }
+                    out += m_Text[m_Position++];
+                }
+                return consume('"');
+            }
+
+            bool number(double& out) {
+                skip_space();
+                char const * begin = m_Text.c_str() + m_Position;
+                char * end;
+                out = std::strtod(begin, &end);
+                if (end == begin) {
+                    return false;
+                }
+                m_Position += end - begin;
+                return true;
+            }
+
+            bool consume(char expected) {
+                skip_space();
+                if (m_Position < m_Text.size() and m_Text[m_Position] == expected) {
+                    ++m_Position;
+                    return true;
+                }
+                return false;
+            }
+
+            void skip_space() {
+                while (m_Position < m_Text.size() and std::isspace(static_cast<unsigned char>(m_Text[m_Position]))) {
+                    ++m_Position;
+                }
+            }
+
+            std::string m_Text;
+            size_t m_Position = 0;
+        };
+    }
+
+    Run const * Results::find(std::string const& name) const {
+        auto it = std::find_if(runs.begin(), runs.end(), [&](Run const& run) { return run.name == name; });
+        return it == runs.end() ? nullptr : &*it;
+    }
+
+    void write_json(std::ostream& out, Results const& results) {
+        out.precision(12);
+        out << "{\n  \"operations\": " << results.operations << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.runs.size(); ++i) {
+            Run const& run = results.runs[i];
+            out << "    {\"name\": \"" << run.name << "\", \"repetitions\": [\n";
+            for (size_t r = 0; r < run.repetitions.size(); ++r) {
+                out << "      {";
+                bool first = true;
+                for (auto const& [metric, value] : run.repetitions[r]) {
+                    out << (first ? "" : ", ") << "\"" << metric << "\": " << value;
+                    first = false;
+                }
+                out << "}" << (r + 1 < run.repetitions.size() ? "," : "") << "\n";
+            }
+            out << "    ]}" << (i + 1 < results.runs.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+    std::optional<Results> read_json(std::istream& in) {
+        return Parser{std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}}}.results();
+    }
+
+    std::vector<double> samples(Run const& run, std::string const& metric) {
+        std::vector<double> values;
+        for (auto const& repetition : run.repetitions) {
+            if (auto it = repetition.find(metric); it != repetition.end()) {
+                values.push_back(it->second);
+            }
+        }
+        return values;
+    }
+
+    std::optional<double> median(Run const& run, std::string const& metric) {
+        std::vector<double> values = samples(run, metric);
+        if (values.empty()) {
+            return std::nullopt;
+        }
+        std::sort(values.begin(), values.end());
+        size_t const middle = values.size() / 2;
+        return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+    Benchmark results as passivegc_bench writes them with --json:
+
+        {"operations": N, "benchmarks": [{"name": "...", "repetitions": [{"metric": value, ...}, ...]}, ...]}
+
+    Reading them back is what the regression gate (--baseline) is built on.
+*/
+namespace Bench {
+    struct Run {
+        std::string name;
+        std::vector<std::map<std::string, double>> repetitions;
+    };
+
+    struct Results {
+        size_t operations = 0;
+        std::vector<Run> runs;
+
+        Run const * find(std::string const& name) const;
+    };
+
+    void write_json(std::ostream& out, Results const& results);
+    // Empty when the input isn't in the format above.
+    std::optional<Results> read_json(std::istream& in);
+
+    // Values of `metric` from the repetitions that reported it, in repetition order.
+    std::vector<double> samples(Run const& run, std::string const& metric);
+
+    // Median of `metric` over the repetitions that reported it.
+    std::optional<double> median(Run const& run, std::string const& metric);
+}
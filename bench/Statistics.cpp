@@ -0,0 +1,134 @@
+#include "Statistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace Bench::Statistics {
+    namespace {
+        // Biggest side the exact distribution is worked out for, beyond it the normal approximation is as good.
+        constexpr size_t exact_limit = 50;
+
+        /*
+            Probability of every U from 0 to m * n when both sides come from the same distribution. Counts the
+            orderings of m befores and n afters giving each U, adding the afters one at a time: the newest after
+            is the biggest value so far, so it adds as many to U as there are befores under it.
+        */
+        std::vector<double> u_distribution(size_t m, size_t n) {
+            // counts[i][u], orderings of i befores and the afters added so far.
+            std::vector<std::vector<double>> counts(m + 1, std::vector<double>(m * n + 1, 0));
+            for (size_t i = 0; i <= m; ++i) {
+                counts[i][0] = 1;
+            }
+            for (size_t j = 1; j <= n; ++j) {
+                std::vector<std::vector<double>> next(m + 1, std::vector<double>(m * n + 1, 0));
+                next[0][0] = 1;
+                for (size_t i = 1; i <= m; ++i) {
+                    for (size_t u = 0; u <= m * n; ++u) {
+                        // The biggest value is a before, adding nothing, or the newest after, beating all i befores.
+                        next[i][u] = next[i - 1][u] + (u >= i ? counts[i][u - i] : 0);
+                    }
+                }
+                counts = std::move(next);
+            }
+            double total = 0;
+            for (double count : counts[m]) {
+                total += count;
+            }
+            for (double& count : counts[m]) {
+                count /= total;
+            }
+            return counts[m];
+        }
+
+        double normal_upper_tail(double z) {
+            return 0.5 * std::erfc(z / std::sqrt(2.0));
+        }
+
+        // z with normal_upper_tail(z) == tail, by bisection, tail in (0, 0.5].
+        double normal_quantile(double tail) {
+            double low = 0, high = 40;
+            for (int i = 0; i < 200; ++i) {
+                double const middle = (low + high) / 2;
+                (normal_upper_tail(middle) > tail ? low : high) = middle;
+            }
+            return (low + high) / 2;
+        }
+    }
+
+    Comparison mann_whitney(std::vector<double> const& before, std::vector<double> const& after, double confidence) {
+        Comparison result;
+        size_t const m = before.size();
+        size_t const n = after.size();
+        if (m == 0 or n == 0) {
+            return result;
+        }
+        double const pairs = static_cast<double>(m * n);
+
+        std::vector<double> differences;
+        differences.reserve(m * n);
+        bool ties = false;
+        for (double x : before) {
+            for (double y : after) {
+                result.u += y > x ? 1 : y == x ? 0.5 : 0;
+                ties = ties or y == x;
+                differences.push_back(y - x);
+            }
+        }
+        std::sort(differences.begin(), differences.end());
+        size_t const middle = differences.size() / 2;
+        result.shift = differences.size() % 2 ? differences[middle] : (differences[middle - 1] + differences[middle]) / 2;
+
+        // Ties within a side matter too, for the variance. Every value has to be counted, whether or not a tie
+        // turned up already, or the correction below comes out short.
+        std::map<double, size_t> groups;
+        for (double x : before) {
+            ++groups[x];
+        }
+        for (double y : after) {
+            ++groups[y];
+        }
+        for (auto const& [value, count] : groups) {
+            ties = ties or count > 1;
+        }
+
+        double const alpha = 1 - confidence;
+        // The interval is [k-th smallest difference, k-th biggest], k the number of Us in each tail
+        // that together hold no more than alpha.
+        size_t k = 0;
+        result.exact = not ties and m <= exact_limit and n <= exact_limit;
+        if (result.exact) {
+            std::vector<double> const distribution = u_distribution(m, n);
+            size_t const u = static_cast<size_t>(result.u);
+            double below = 0, above = 0;
+            for (size_t value = 0; value < distribution.size(); ++value) {
+                below += value <= u ? distribution[value] : 0;
+                above += value >= u ? distribution[value] : 0;
+            }
+            result.p = std::min(1.0, 2 * std::min(below, above));
+            // The whole distribution sums to 1, so this stops before running off the end.
+            for (double tail = distribution[0]; tail <= alpha / 2;) {
+                tail += distribution[++k];
+            }
+        } else {
+            double const total = static_cast<double>(m + n);
+            double correction = 0;
+            for (auto const& [value, count] : groups) {
+                double const t = static_cast<double>(count);
+                correction += t * t * t - t;
+            }
+            double const variance = pairs / 12 * ((total + 1) - correction / (total * (total - 1)));
+            if (variance > 0) {
+                double const z = std::max(0.0, std::abs(result.u - pairs / 2) - 0.5) / std::sqrt(variance);
+                result.p = std::min(1.0, 2 * normal_upper_tail(z));
+            }
+            double const spread = normal_quantile(alpha / 2) * std::sqrt(pairs * (total + 1) / 12);
+            k = static_cast<size_t>(std::max(0.0, std::floor(pairs / 2 - spread)));
+        }
+        // Too few values for the confidence asked for: the widest interval there is, with less confidence than asked.
+        k = std::clamp<size_t>(k, 1, (differences.size() + 1) / 2);
+        result.shift_low = differences[k - 1];
+        result.shift_high = differences[differences.size() - k];
+        return result;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+    Distribution free statistics for comparing two sets of benchmark repetitions. Benchmark timings are
+    skewed and have outliers (a page fault storm, a context switch), so nothing here assumes they're normal.
+*/
+namespace Bench::Statistics {
+    struct Comparison {
+        // Mann-Whitney U of `after` against `before`: how many of the pairs have the after value bigger, ties count half.
+        double u = 0;
+        // Two sided p value for "both come from the same distribution".
+        double p = 1;
+        // Hodges-Lehmann estimate of how far `after` moved from `before`, the median of every after - before difference.
+        double shift = 0;
+        // Confidence interval for the shift at the requested confidence.
+        double shift_low = 0;
+        double shift_high = 0;
+        // Whether p came from the exact distribution of U, which is only used when there are no ties and
+        // both sides are small. Otherwise it's the normal approximation with tie and continuity corrections.
+        bool exact = false;
+    };
+
+    /*
+        Mann-Whitney U test with the matching confidence interval for the shift. Both sides need at least one
+        value, with fewer than three a side nothing short of a huge difference comes out significant.
+    */
+    Comparison mann_whitney(std::vector<double> const& before, std::vector<double> const& after, double confidence = 0.95);
+}
@@ -0,0 +1,126 @@
+/*
+    Compares two passivegc_bench --json outputs, say from two commits, case by case and metric by metric.
+
+    A plain median comparison like --baseline flags noise as often as it misses small regressions. This
+    runs a Mann-Whitney U test on the repetitions of each metric instead, and gives a confidence interval
+    for how far the metric moved (Hodges-Lehmann, in percent of the baseline median). A metric regressed
+    when the test is significant at --alpha, it moved the wrong way, and the move is bigger than
+    --threshold percent (1 by default, so a peak RSS a page bigger every time doesn't count).
+
+    Metrics compared: ops_per_sec (higher is better), every *_p99_ns latency and peak_rss_kib (lower is
+    better), plus any --metric given. Names ending in _per_sec and ipc are taken as higher is better.
+
+    Use enough repetitions: with 5 a side the smallest two sided p there is is 0.008, with 3 a side it's 0.1
+    and nothing is ever significant at the default alpha.
+
+    Usage: passivegc_compare baseline.json current.json [--alpha 0.05] [--threshold 1] [--metric name]...
+
+    Exits with 1 when anything regressed, 2 on bad input.
+*/
+#include "Results.hpp"
+#include "Statistics.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+    bool higher_is_better(std::string const& metric) {
+        return metric == "ipc" or (metric.size() >= 8 and metric.compare(metric.size() - 8, 8, "_per_sec") == 0);
+    }
+
+    bool compared(std::string const& metric, std::set<std::string> const& extra) {
+        bool const p99 = metric.size() >= 7 and metric.compare(metric.size() - 7, 7, "_p99_ns") == 0;
+        return metric == "ops_per_sec" or metric == "peak_rss_kib" or p99 or extra.contains(metric);
+    }
+
+    std::optional<Bench::Results> load(char const * path) {
+        std::ifstream in{path};
+        std::optional<Bench::Results> results = Bench::read_json(in);
+        if (not results) {
+            std::fprintf(stderr, "Couldn't read %s\n", path);
+        }
+        return results;
+    }
+}
+
+auto main(int argc, char** argv) -> int {
+    std::vector<char const*> paths;
+    std::set<std::string> extra;
+    double alpha = 0.05;
+    double threshold = 0.01;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        bool const has_value = i + 1 < argc;
+        if (arg == "--alpha" and has_value) {
+            alpha = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--threshold" and has_value) {
+            threshold = std::strtod(argv[++i], nullptr) / 100;
+        } else if (arg == "--metric" and has_value) {
+            extra.insert(argv[++i]);
+        } else if (arg.starts_with("--")) {
+            paths.clear();
+            break;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2 or not (alpha > 0 and alpha < 1)) {
+        std::fprintf(stderr, "Usage: %s baseline.json current.json [--alpha 0.05] [--threshold 1] [--metric name]...\n", argv[0]);
+        return 2;
+    }
+
+    auto const baseline = load(paths[0]);
+    auto const current = load(paths[1]);
+    if (not baseline or not current) {
+        return 2;
+    }
+    if (baseline->operations != current->operations) {
+        std::fprintf(stderr, "Baseline ran %zu operations, this run %zu, they can't be compared\n", baseline->operations, current->operations);
+        return 2;
+    }
+
+    std::printf("%-32s %-24s %14s %14s %9s %22s %8s\n", "benchmark", "metric", "baseline", "current", "change", "interval", "p");
+    size_t regressions = 0;
+    for (Bench::Run const& run : current->runs) {
+        Bench::Run const * base = baseline->find(run.name);
+        if (base == nullptr) {
+            std::printf("%-32s not in the baseline, skipped\n", run.name.c_str());
+            continue;
+        }
+        std::set<std::string> metrics;
+        for (auto const& repetition : run.repetitions) {
+            for (auto const& [metric, value] : repetition) {
+                if (compared(metric, extra)) {
+                    metrics.insert(metric);
+                }
+            }
+        }
+        for (std::string const& metric : metrics) {
+            std::vector<double> const before = Bench::samples(*base, metric);
+            std::vector<double> const after = Bench::samples(run, metric);
+            auto const base_median = Bench::median(*base, metric);
+            if (before.empty() or not base_median or *base_median == 0) {
+                continue;
+            }
+            Bench::Statistics::Comparison const comparison = Bench::Statistics::mann_whitney(before, after, 1 - alpha);
+            double const scale = 100 / std::abs(*base_median);
+            // Positive is worse, whichever way the metric points.
+            double const worse = (higher_is_better(metric) ? -comparison.shift : comparison.shift) * scale;
+            bool const regressed = comparison.p < alpha and worse > threshold * 100;
+            bool const improved = comparison.p < alpha and worse < -threshold * 100;
+            regressions += regressed;
+            char interval[64];
+            std::snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", comparison.shift_low * scale, comparison.shift_high * scale);
+            std::printf("%-32s %-24s %14.6g %14.6g %+8.1f%% %22s %8.4f%s\n", run.name.c_str(), metric.c_str(), *base_median,
+                *Bench::median(run, metric), comparison.shift * scale, interval, comparison.p,
+                regressed ? "  REGRESSED" : improved ? "  improved" : "");
+        }
+    }
+    std::printf("%zu regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/*
+    Worst-case latency of the heap backends.
+    Runs the same randomized allocate/free churn against every backend and reports latency
+    percentiles and the worst single call for both operations. Tail latency is what matters
+    here, the mean is reported only for reference.
+*/
+#include "Bench.hpp"
+
+#include "MemManage.hpp"
+
+#include <optional>
+#include <random>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    // Element with a user provided constructor, so allocate_constructed_n doesn't zero the buffer and we time the heap only.
+    struct Raw {
+        Raw() {}
+        unsigned char byte;
+    };
+
+    // Live objects at any time.
+    constexpr size_t window = 4096;
+
+    template<typename Heap_>
+    void churn(Bench::Context& ctx, Heap_& heap) {
+        using Buffer = typename Heap_::template Pointer<Raw, true>;
+        std::vector<long long> allocate, free;
+        allocate.reserve(ctx.operations);
+        free.reserve(ctx.operations);
+        std::vector<std::optional<Buffer>> live(window);
+        std::mt19937_64 rng{42};
+        // Mostly small objects with an occasional large buffer, like a request path does.
+        std::uniform_int_distribution<size_t> small{16, 1024};
+        std::uniform_int_distribution<size_t> large{4096, 256 * 1024};
+        std::uniform_int_distribution<size_t> slot{0, window - 1};
+
+        auto const started = Bench::Clock::now();
+        for (size_t i = 0; i < ctx.operations; ++i) {
+            auto& target = live[slot(rng)];
+            if (target) {
+                auto const start = Bench::Clock::now();
+                target.reset();
+                free.push_back((Bench::Clock::now() - start).count());
+            }
+            size_t const size = rng() % 16 == 0 ? large(rng) : small(rng);
+            auto const start = Bench::Clock::now();
+            target.emplace(heap.template allocate_constructed_n<Raw>(size));
+            allocate.push_back((Bench::Clock::now() - start).count());
+        }
+        // An operation is one allocation, and the free of whatever held its slot before.
+        ctx.completed(ctx.operations, Bench::seconds_since(started));
+        Bench::report_latencies(ctx, "allocate", allocate);
+        Bench::report_latencies(ctx, "free", free);
+    }
+}
+
+PASSIVEGC_BENCH(segments_latency) {
+    Heap heap;
+    churn(ctx, heap);
+}
+
+PASSIVEGC_BENCH(tlsf_latency) {
+    // Big enough that the pool never has to grow, so every call stays bounded.
+    TlsfHeap heap{Backends::Tlsf::Options{.pool_size = window * 256 * 1024 * 2}};
+    churn(ctx, heap);
+}
+
+PASSIVEGC_BENCH(slab_latency) {
+    SlabHeap heap;
+    churn(ctx, heap);
+}
@@ -0,0 +1,198 @@
+/*
+    Runs the registered benchmark cases.
+
+    Usage: passivegc_bench [--filter substring] [--operations n] [--repetitions n] [--threads 1,2,4]
+                           [--json file] [--baseline file [--tolerance percent]] [--list]
+
+    Scaling cases run at every thread count of --threads, 1 and every power of two up to the
+    number of cores (and the number of cores itself) by default.
+
+    With --baseline, the run is compared against an earlier --json output of the same cases and
+    exits with 1 when the median throughput (ops_per_sec) dropped, or the median peak RSS grew,
+    by more than the tolerance (10% by default). passivegc_compare compares two --json outputs with a
+    significance test instead, for runs with several repetitions.
+
+    Every repetition is also counted with perf_event_open: cycles, instructions, L1 data, last level
+    cache and dTLB misses and page faults, each reported per operation (all threads together), and
+    instructions per cycle. Counters the machine doesn't give out are skipped with a note, --no-counters
+    leaves them all out.
+*/
+#include "Bench.hpp"
+#include "Counters.hpp"
+#include "Results.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    std::vector<size_t> default_threads() {
+        size_t const cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        std::vector<size_t> threads;
+        for (size_t count = 1; count < cores; count *= 2) {
+            threads.push_back(count);
+        }
+        threads.push_back(cores);
+        return threads;
+    }
+
+    std::vector<size_t> parse_threads(std::string const& list) {
+        std::vector<size_t> threads;
+        std::istringstream in{list};
+        std::string count;
+        while (std::getline(in, count, ',')) {
+            threads.push_back(std::max<size_t>(std::strtoull(count.c_str(), nullptr, 10), 1));
+        }
+        return threads;
+    }
+
+    // Compares the medians of every case that is in both runs. Returns false on any regression.
+    bool check_regressions(Bench::Results const& current, Bench::Results const& baseline, double tolerance) {
+        bool passed = true;
+        for (Bench::Run const& run : current.runs) {
+            Bench::Run const * base = baseline.find(run.name);
+            if (base == nullptr) {
+                std::printf("%s: not in the baseline, skipped\n", run.name.c_str());
+                continue;
+            }
+            auto const throughput = Bench::median(run, "ops_per_sec");
+            auto const base_throughput = Bench::median(*base, "ops_per_sec");
+            if (throughput and base_throughput and *throughput < *base_throughput * (1 - tolerance)) {
+                std::printf("%s: throughput regressed, %.6g ops/s against %.6g\n", run.name.c_str(), *throughput, *base_throughput);
+                passed = false;
+            }
+            auto const peak = Bench::median(run, "peak_rss_kib");
+            auto const base_peak = Bench::median(*base, "peak_rss_kib");
+            if (peak and base_peak and *peak > *base_peak * (1 + tolerance)) {
+                std::printf("%s: peak RSS regressed, %.6g KiB against %.6g\n", run.name.c_str(), *peak, *base_peak);
+                passed = false;
+            }
+        }
+        return passed;
+    }
+}
+
+auto main(int argc, char** argv) -> int {
+    std::string filter;
+    std::string json;
+    std::string baseline;
+    double tolerance = 0.10;
+    size_t operations = 1000000;
+    size_t repetitions = 1;
+    std::vector<size_t> threads = default_threads();
+    bool list = false;
+    bool counters = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        bool const has_value = i + 1 < argc;
+        if (arg == "--filter" and has_value) {
+            filter = argv[++i];
+        } else if (arg == "--operations" and has_value) {
+            operations = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repetitions" and has_value) {
+            repetitions = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--threads" and has_value) {
+            threads = parse_threads(argv[++i]);
+        } else if (arg == "--json" and has_value) {
+            json = argv[++i];
+        } else if (arg == "--baseline" and has_value) {
+            baseline = argv[++i];
+        } else if (arg == "--tolerance" and has_value) {
+            tolerance = std::strtod(argv[++i], nullptr) / 100;
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg == "--no-counters") {
+            counters = false;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--filter substring] [--operations n] [--repetitions n] [--threads 1,2,4] [--json file] [--baseline file [--tolerance percent]] [--no-counters] [--list]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::optional<Bench::PerfCounters> perf;
+    if (counters and not list) {
+        perf.emplace();
+        std::string missing;
+        for (std::string const& name : perf->missing()) {
+            missing += (missing.empty() ? "" : ", ") + name;
+        }
+        if (not missing.empty()) {
+            std::fprintf(stderr, "Counters not available here (perf_event_paranoid, or no PMU in a VM): %s\n", missing.c_str());
+        }
+    }
+
+    Bench::Results results{operations, {}};
+    for (Bench::Case const& bench : Bench::registry()) {
+        if (bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        if (list) {
+            std::printf("%s\n", bench.name.c_str());
+            continue;
+        }
+        for (size_t thread_count : bench.scaling ? threads : std::vector<size_t>{1}) {
+            std::string const name = bench.scaling ? bench.name + "/t" + std::to_string(thread_count) : bench.name;
+            Bench::Run& run = results.runs.emplace_back(Bench::Run{name, {}});
+            for (size_t r = 0; r < repetitions; ++r) {
+                Bench::Context ctx{operations, thread_count};
+                Bench::reset_peak_rss();
+                if (perf) {
+                    perf->start();
+                }
+                auto const start = Bench::Clock::now();
+                bench.function(ctx);
+                double const seconds = Bench::seconds_since(start);
+                if (perf) {
+                    perf->stop();
+                    perf->report(ctx, static_cast<double>(ctx.operations_completed()));
+                }
+                ctx.metric("wall_seconds", seconds);
+                if (not ctx.metrics().contains("ops_per_sec")) {
+                    ctx.metric("ops_per_sec", static_cast<double>(ctx.operations_completed()) / seconds);
+                }
+                if (bench.scaling) {
+                    ctx.metric("threads", static_cast<double>(thread_count));
+                }
+                ctx.metric("rss_kib", static_cast<double>(Bench::rss_kib()));
+                ctx.metric("peak_rss_kib", static_cast<double>(Bench::peak_rss_kib()));
+                run.repetitions.push_back(ctx.metrics());
+
+                std::printf("%s", name.c_str());
+                for (auto const& [metric, value] : ctx.metrics()) {
+                    std::printf("  %s=%.6g", metric.c_str(), value);
+                }
+                std::printf("\n");
+            }
+        }
+    }
+
+    if (not json.empty()) {
+        std::ofstream out{json};
+        if (not out) {
+            std::fprintf(stderr, "Couldn't write %s\n", json.c_str());
+            return 1;
+        }
+        Bench::write_json(out, results);
+    }
+
+    if (not baseline.empty()) {
+        std::ifstream in{baseline};
+        std::optional<Bench::Results> base = Bench::read_json(in);
+        if (not base) {
+            std::fprintf(stderr, "Couldn't read %s\n", baseline.c_str());
+            return 1;
+        }
+        if (base->operations != operations) {
+            std::fprintf(stderr, "Baseline ran %zu operations, this run %zu, they can't be compared\n", base->operations, operations);
+            return 1;
+        }
+        return check_regressions(results, *base, tolerance) ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+    Multi-threaded scaling suite, ports of the usual allocator stress tests (mimalloc-bench and
+    the papers it comes from), shrunk to what one process and ctx.operations allow:
+
+    larson          Server simulation. Every thread replaces random blocks in its own array, and
+                    between rounds the arrays move on to the next thread, so blocks are freed by
+                    a different thread than the one that allocated them.
+    xmalloc         Producers and consumers. Threads allocate batches, hand them through a shared
+                    queue, and free whatever batch they get, usually someone else's.
+    cache_scratch   False sharing. Each thread frees one small object allocated by the main thread,
+                    then allocates, writes and frees objects of that size in a loop. An allocator
+                    that gives neighbouring objects to different threads makes the cores fight
+                    over cache lines.
+    cfrac           Small object churn in stack order, like a bignum library: short lived 8 to 64
+                    byte blocks with the occasional longer lived one.
+    alloc_test      Random replacement in a ring of live blocks with a skewed size mix, mostly
+                    small, sometimes up to 64 KiB, every block written once.
+
+    Every workload runs against system malloc and the locked heap backends. Each thread does
+    about ctx.operations operations, the exact total of all threads goes to ctx.completed(). The
+    harness adds the thread count and peak RSS.
+*/
+#include "Bench.hpp"
+
+#include "MemManage.hpp"
+
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    // System malloc behind the same two calls as a HeapHandle.
+    struct Malloc {
+        void * allocate(size_t size) const { return std::malloc(size); }
+        void free(void * memory, size_t) const { std::free(memory); }
+    };
+
+    // A locked heap of the given backend, allocated through a HeapHandle like any other user would.
+    template<typename Backend_>
+    struct Locked {
+        using Heap = BasicHeap<Backend_, Policies::Locked, Policies::NoStats>;
+
+        template<typename... Args_>
+        explicit Locked(Args_&&... args) : heap{std::forward<Args_>(args)...}, handle{heap} {}
+
+        void * allocate(size_t size) const { return handle.allocate(size); }
+        void free(void * memory, size_t size) const { handle.free(memory, size); }
+
+        Heap heap;
+        HeapHandle handle;
+    };
+
+    struct Block {
+        void * memory = nullptr;
+        size_t size = 0;
+    };
+
+    // Runs body(thread) on `threads` threads and returns how long it took all of them.
+    template<typename Body_>
+    double run_threads(size_t threads, Body_ const& body) {
+        std::vector<std::thread> workers;
+        auto const start = Bench::Clock::now();
+        for (size_t thread = 0; thread < threads; ++thread) {
+            workers.emplace_back([&body, thread] { body(thread); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        return Bench::seconds_since(start);
+    }
+
+    template<typename Allocator_>
+    void larson(Bench::Context& ctx, Allocator_ const& allocator) {
+        constexpr size_t slots = 1000;
+        constexpr size_t rounds = 4;
+        std::vector<std::vector<Block>> arrays(ctx.threads, std::vector<Block>(slots));
+        double seconds = 0;
+        for (size_t round = 0; round < rounds; ++round) {
+            seconds += run_threads(ctx.threads, [&](size_t thread) {
+                // The array this thread inherits this round, filled by another thread the round before.
+                std::vector<Block>& array = arrays[(thread + round) % ctx.threads];
+                std::mt19937_64 rng{thread * rounds + round};
+                for (size_t i = 0; i < ctx.operations / rounds; ++i) {
+                    Block& block = array[rng() % slots];
+                    if (block.memory != nullptr) {
+                        allocator.free(block.memory, block.size);
+                    }
+                    block.size = 16 + rng() % 1009;
+                    block.memory = allocator.allocate(block.size);
+                    static_cast<unsigned char*>(block.memory)[0] = static_cast<unsigned char>(i);
+                }
+            });
+        }
+        for (auto& array : arrays) {
+            for (Block& block : array) {
+                if (block.memory != nullptr) {
+                    allocator.free(block.memory, block.size);
+                }
+            }
+        }
+        // Rounds split the operations evenly, the remainder is left out.
+        ctx.completed(ctx.threads * (ctx.operations / rounds) * rounds, seconds);
+    }
+
+    template<typename Allocator_>
+    void xmalloc(Bench::Context& ctx, Allocator_ const& allocator) {
+        constexpr size_t batch = 64;
+        std::mutex mutex;
+        std::deque<std::vector<Block>> queue;
+        size_t const batches = std::max<size_t>(ctx.operations / batch, 1);
+        double const seconds = run_threads(ctx.threads, [&](size_t thread) {
+            std::mt19937_64 rng{thread};
+            for (size_t i = 0; i < batches; ++i) {
+                std::vector<Block> produced(batch);
+                for (Block& block : produced) {
+                    block.size = 8 + rng() % 249;
+                    block.memory = allocator.allocate(block.size);
+                    std::memset(block.memory, 1, std::min<size_t>(block.size, 16));
+                }
+                std::vector<Block> consumed;
+                {
+                    std::lock_guard lock{mutex};
+                    queue.push_back(std::move(produced));
+                    consumed = std::move(queue.front());
+                    queue.pop_front();
+                }
+                for (Block const& block : consumed) {
+                    allocator.free(block.memory, block.size);
+                }
+            }
+        });
+        // Every thread pushed as many batches as it popped, nothing is left over.
+        ctx.completed(ctx.threads * batches * batch, seconds);
+    }
+
+    template<typename Allocator_>
+    void cache_scratch(Bench::Context& ctx, Allocator_ const& allocator) {
+        constexpr size_t size = 8;
+        constexpr size_t writes = 50;
+        std::vector<void*> initial(ctx.threads);
+        for (void*& memory : initial) {
+            memory = allocator.allocate(size);
+        }
+        double const seconds = run_threads(ctx.threads, [&](size_t thread) {
+            allocator.free(initial[thread], size);
+            for (size_t i = 0; i < ctx.operations; ++i) {
+                auto * object = static_cast<volatile unsigned char*>(allocator.allocate(size));
+                for (size_t write = 0; write < writes; ++write) {
+                    object[write % size] = static_cast<unsigned char>(object[write % size] + 1);
+                }
+                allocator.free(const_cast<unsigned char*>(object), size);
+            }
+        });
+        ctx.completed(ctx.threads * ctx.operations, seconds);
+    }
+
+    template<typename Allocator_>
+    void cfrac(Bench::Context& ctx, Allocator_ const& allocator) {
+        double const seconds = run_threads(ctx.threads, [&](size_t thread) {
+            std::mt19937_64 rng{thread};
+            std::vector<Block> stack;
+            std::vector<Block> kept;
+            for (size_t i = 0; i < ctx.operations; ++i) {
+                // Grow the stack about as often as it shrinks, with depth capped like a recursion would be.
+                if (stack.empty() or (stack.size() < 64 and rng() % 2 == 0)) {
+                    Block block{nullptr, 8 + 8 * (rng() % 8)};
+                    block.memory = allocator.allocate(block.size);
+                    std::memset(block.memory, 0, block.size);
+                    stack.push_back(block);
+                } else if (rng() % 64 == 0) {
+                    // A result that outlives the computation.
+                    kept.push_back(stack.back());
+                    stack.pop_back();
+                } else {
+                    allocator.free(stack.back().memory, stack.back().size);
+                    stack.pop_back();
+                }
+            }
+            for (Block const& block : stack) {
+                allocator.free(block.memory, block.size);
+            }
+            for (Block const& block : kept) {
+                allocator.free(block.memory, block.size);
+            }
+        });
+        ctx.completed(ctx.threads * ctx.operations, seconds);
+    }
+
+    template<typename Allocator_>
+    void alloc_test(Bench::Context& ctx, Allocator_ const& allocator) {
+        constexpr size_t ring = 2048;
+        double const seconds = run_threads(ctx.threads, [&](size_t thread) {
+            std::mt19937_64 rng{thread};
+            std::vector<Block> live(ring);
+            for (size_t i = 0; i < ctx.operations; ++i) {
+                Block& block = live[rng() % ring];
+                if (block.memory != nullptr) {
+                    allocator.free(block.memory, block.size);
+                }
+                // Every doubling of the size is half as likely.
+                size_t const bits = static_cast<size_t>(std::countr_zero(rng() | (uint64_t{1} << 11)));
+                block.size = (size_t{16} << bits) + rng() % (size_t{16} << bits);
+                block.memory = allocator.allocate(block.size);
+                std::memset(block.memory, static_cast<int>(i), block.size);
+            }
+            for (Block const& block : live) {
+                if (block.memory != nullptr) {
+                    allocator.free(block.memory, block.size);
+                }
+            }
+        });
+        ctx.completed(ctx.threads * ctx.operations, seconds);
+    }
+
+    // Pools big enough for every workload at a few threads, growing past that.
+    Backends::Tlsf::Options tlsf_options() {
+        return Backends::Tlsf::Options{.pool_size = size_t{64} << 20, .grow = true};
+    }
+}
+
+#define PASSIVEGC_SCALING_CASES(workload)                                           \
+    PASSIVEGC_BENCH_SCALING(workload##_malloc) {                                    \
+        workload(ctx, Malloc{});                                                    \
+    }                                                                               \
+    PASSIVEGC_BENCH_SCALING(workload##_segments) {                                  \
+        workload(ctx, Locked<Backends::Segments>{});                                \
+    }                                                                               \
+    PASSIVEGC_BENCH_SCALING(workload##_tlsf) {                                      \
+        workload(ctx, Locked<Backends::Tlsf>{tlsf_options()});                      \
+    }                                                                               \
+    PASSIVEGC_BENCH_SCALING(workload##_slab) {                                      \
+        workload(ctx, Locked<Backends::Slab>{});                                    \
+    }
+
+PASSIVEGC_SCALING_CASES(larson)
+PASSIVEGC_SCALING_CASES(xmalloc)
+PASSIVEGC_SCALING_CASES(cache_scratch)
+PASSIVEGC_SCALING_CASES(cfrac)
+PASSIVEGC_SCALING_CASES(alloc_test)
@@ -0,0 +1,189 @@
+/*
+    Long running fragmentation soak.
+
+    Mixed lifetimes and sizes for many millions of operations against one heap, sampling memory use every
+    --interval operations into a CSV time series. A heap that fragments shows it as RSS climbing away from
+    the live bytes long after the live set stopped growing, something a short benchmark never runs long
+    enough to see.
+
+    Every operation allocates one block and gives it a lifetime in operations:
+        short   70%  1 to 100, temporaries
+        medium  25%  100 to 10 000, requests and caches
+        long     5%  10 000 to 1 000 000, sessions and the like
+    and frees every block whose lifetime ran out. Sizes are mostly small, every doubling half as likely,
+    from 16 bytes up to 64 KiB, with one in a thousand between 64 KiB and 1 MiB. When --live blocks are
+    live already, the one closest to expiring goes first. Every block is written once so its pages are
+    really there.
+
+    Columns:
+        operations      Operations done so far.
+        seconds         Wall time so far.
+        rss_kib         Resident set size of the process.
+        live_bytes      Bytes the workload holds right now.
+        reserved_bytes  What the heap has reserved for them, empty for backends that don't know (segments).
+        fragmentation   RSS grown since the start over live bytes, 1 is perfect. Covers what the heap keeps
+                        outside its own books too, e.g. the malloc arenas behind segments.
+
+    Usage: passivegc_soak [--backend segments|tlsf|buddy|slab] [--operations n] [--interval n] [--live n]
+                          [--seed n] [--csv file]
+
+    Segments frees in O(live blocks), give it a smaller --live or fewer operations.
+*/
+#include "Bench.hpp"
+
+#include "MemManage.hpp"
+
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    struct Options {
+        size_t operations = 10000000;
+        size_t interval = 100000;
+        size_t live = 100000;
+        uint64_t seed = 1;
+    };
+
+    struct Block {
+        size_t expires;
+        void * memory;
+        size_t size;
+
+        // Earliest expiry on top of the std::priority_queue.
+        bool operator<(Block const& other) const { return expires > other.expires; }
+    };
+
+    size_t lifetime(std::mt19937_64& rng) {
+        uint64_t const pick = rng() % 100;
+        if (pick < 70) {
+            return 1 + rng() % 100;
+        }
+        if (pick < 95) {
+            return 100 + rng() % 9900;
+        }
+        return 10000 + rng() % 990000;
+    }
+
+    size_t block_size(std::mt19937_64& rng) {
+        if (rng() % 1000 == 0) {
+            return (size_t{64} << 10) + rng() % (size_t{960} << 10);
+        }
+        // Every doubling of the size is half as likely, up to 32 KiB to 64 KiB.
+        size_t const bits = static_cast<size_t>(std::countr_zero(rng() | (uint64_t{1} << 11)));
+        return (size_t{16} << bits) + rng() % (size_t{16} << bits);
+    }
+
+    template<typename Backend_, typename... Args_>
+    void soak(Options const& options, FILE * csv, Args_&&... args) {
+        BasicHeap<Backend_, Policies::SingleThreaded, Policies::BasicStats> heap{std::forward<Args_>(args)...};
+        HeapHandle handle{heap};
+        std::mt19937_64 rng{options.seed};
+        std::priority_queue<Block> live;
+        size_t live_bytes = 0;
+        size_t const baseline_kib = Bench::rss_kib();
+        auto const start = Bench::Clock::now();
+
+        auto const release = [&] {
+            Block const& block = live.top();
+            handle.free(block.memory, block.size);
+            live_bytes -= block.size;
+            live.pop();
+        };
+
+        auto const sample = [&](size_t operations) {
+            size_t const rss_kib = Bench::rss_kib();
+            double const grown = rss_kib > baseline_kib ? static_cast<double>(rss_kib - baseline_kib) * 1024 : 0;
+            std::string reserved;
+            if (auto const reserved_bytes = heap.metrics("soak").reserved_bytes) {
+                reserved = std::to_string(*reserved_bytes);
+            }
+            std::fprintf(csv, "%zu,%.3f,%zu,%zu,%s,%.4f\n", operations, Bench::seconds_since(start), rss_kib, live_bytes,
+                reserved.c_str(), live_bytes > 0 ? grown / static_cast<double>(live_bytes) : 0.0);
+            std::fflush(csv);
+        };
+
+        std::fprintf(csv, "operations,seconds,rss_kib,live_bytes,reserved_bytes,fragmentation\n");
+        sample(0);
+        for (size_t operation = 1; operation <= options.operations; ++operation) {
+            while (not live.empty() and live.top().expires <= operation) {
+                release();
+            }
+            if (live.size() >= options.live) {
+                release();
+            }
+            Block block{operation + lifetime(rng), nullptr, block_size(rng)};
+            block.memory = handle.allocate(block.size);
+            std::memset(block.memory, static_cast<int>(operation), block.size);
+            live_bytes += block.size;
+            live.push(block);
+            if (operation % options.interval == 0 or operation == options.operations) {
+                sample(operation);
+            }
+        }
+        while (not live.empty()) {
+            release();
+        }
+    }
+}
+
+auto main(int argc, char** argv) -> int {
+    Options options;
+    std::string backend = "tlsf";
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        bool const has_value = i + 1 < argc;
+        if (arg == "--backend" and has_value) {
+            backend = argv[++i];
+        } else if (arg == "--operations" and has_value) {
+            options.operations = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--interval" and has_value) {
+            options.interval = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--live" and has_value) {
+            options.live = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--seed" and has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--csv" and has_value) {
+            path = argv[++i];
+        } else {
+            std::fprintf(stderr, "Usage: %s [--backend segments|tlsf|buddy|slab] [--operations n] [--interval n] [--live n] [--seed n] [--csv file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    FILE * csv = stdout;
+    if (not path.empty()) {
+        csv = std::fopen(path.c_str(), "w");
+        if (csv == nullptr) {
+            std::fprintf(stderr, "Couldn't write %s\n", path.c_str());
+            return 1;
+        }
+    }
+
+    if (backend == "segments") {
+        soak<Backends::Segments>(options, csv);
+    } else if (backend == "tlsf") {
+        soak<Backends::Tlsf>(options, csv, Backends::Tlsf::Options{.grow = true});
+    } else if (backend == "buddy") {
+        soak<Backends::Buddy>(options, csv, Backends::Buddy::Options{});
+    } else if (backend == "slab") {
+        soak<Backends::Slab>(options, csv);
+    } else {
+        std::fprintf(stderr, "Unknown backend %s\n", backend.c_str());
+        return 2;
+    }
+    if (csv != stdout) {
+        std::fclose(csv);
+    }
+    return 0;
+}
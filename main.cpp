@@ -17,7 +17,7 @@ auto test() {
 
     std::cout << "Press enter to move out pointer." << std::endl;
     getchar();
-    return std::move(x);
+    return x;
 }
 
 auto foo() {
@@ -0,0 +1,606 @@
+#include "MemManage.hpp"
+#include "AutomaticMemory/IoBuffers.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace AutomaticMemory;
+
+namespace {
+    long minor_faults() {
+        rusage usage{};
+        ::getrusage(RUSAGE_THREAD, &usage);
+        return usage.ru_minflt;
+    }
+
+#if defined(__SANITIZE_ADDRESS__) or defined(__SANITIZE_THREAD__)
+    // Touching application memory faults in the sanitizer's shadow memory too, fault counts mean nothing.
+    constexpr long fault_slack = std::numeric_limits<long>::max();
+#else
+    constexpr long fault_slack = 16;
+#endif
+
+    // Minor faults taken while writing to every page of [memory, memory + size).
+    long faults_touching(void * memory, size_t size) {
+        long const before = minor_faults();
+        for (size_t offset = 0; offset < size; offset += Os::page_size()) {
+            static_cast<unsigned char volatile*>(memory)[offset] = 1;
+        }
+        return minor_faults() - before;
+    }
+
+    struct Block {
+        unsigned char * memory;
+        size_t size;
+    };
+
+    void fill(Block const& block) {
+        std::memset(block.memory, static_cast<int>(block.size & 0xff), block.size);
+    }
+
+    bool intact(Block const& block) {
+        for (size_t i = 0; i < block.size; ++i) {
+            if (block.memory[i] != static_cast<unsigned char>(block.size & 0xff)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Random allocate/free churn that checks no two live blocks ever overlap.
+    template<typename Backend_, typename Size_>
+    void churn(Backend_& backend, Size_ next_size, size_t operations, size_t alignment) {
+        std::mt19937 rng{7};
+        std::vector<Block> live;
+        for (size_t i = 0; i < operations; ++i) {
+            if (live.empty() or rng() % 2) {
+                size_t const size = next_size(rng);
+                Block block{static_cast<unsigned char*>(backend.allocate(size)), size};
+                ASSERT_EQ(reinterpret_cast<uintptr_t>(block.memory) % alignment, 0u);
+                ASSERT_TRUE(backend.owns(block.memory));
+                fill(block);
+                live.push_back(block);
+            } else {
+                size_t const index = rng() % live.size();
+                ASSERT_TRUE(intact(live[index]));
+                ASSERT_TRUE(backend.free(live[index].memory));
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        for (Block const& block : live) {
+            ASSERT_TRUE(intact(block));
+            backend.free(block.memory);
+        }
+    }
+
+    auto small_or_large = [](std::mt19937& rng) -> size_t {
+        return rng() % 8 == 0 ? 4096 + rng() % 100000 : 1 + rng() % 512;
+    };
+}
+
+TEST(Segments, ChurnKeepsBlocksApart) {
+    Backends::Segments backend;
+    churn(backend, small_or_large, 2000, 1);
+}
+
+TEST(Segments, FreeOfForeignMemoryFails) {
+    Backends::Segments backend;
+    int local = 0;
+    EXPECT_FALSE(backend.free(&local));
+}
+
+TEST(Tlsf, ChurnKeepsBlocksApart) {
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = size_t{64} << 20}};
+    churn(backend, small_or_large, 20000, 16);
+}
+
+TEST(Tlsf, CoalescesBackIntoOneBlock) {
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    std::vector<void*> blocks;
+    for (int i = 0; i < 64; ++i) {
+        blocks.push_back(backend.allocate(16000));
+    }
+    EXPECT_THROW(backend.allocate(1 << 19), std::bad_alloc);
+    // Free out of order so both neighbour merges get exercised.
+    for (size_t i = 0; i < blocks.size(); i += 2) {
+        backend.free(blocks[i]);
+    }
+    for (size_t i = 1; i < blocks.size(); i += 2) {
+        backend.free(blocks[i]);
+    }
+    // Bigger than any 16000 byte hole, only fits if everything merged back.
+    EXPECT_NE(backend.allocate(900000), nullptr);
+}
+
+TEST(Tlsf, RefusesMemoryItDidntHandOut) {
+    for (size_t reserve : {size_t{0}, size_t{1} << 30}) {
+        Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = 1 << 20, .reserve = reserve}};
+        void * first = backend.allocate(1000);
+        void * second = backend.allocate(1000);
+        alignas(16) unsigned char local[64] = {};
+        EXPECT_FALSE(backend.free(local + 32));
+        EXPECT_FALSE(backend.free(static_cast<unsigned char*>(second) + 1));
+        EXPECT_FALSE(backend.free(static_cast<unsigned char*>(second) + 512));
+        EXPECT_TRUE(backend.free(second));
+        EXPECT_FALSE(backend.free(second));
+        EXPECT_TRUE(backend.free(first));
+        // The lists are intact, the whole pool merged back.
+        EXPECT_NE(backend.allocate(900000), nullptr);
+    }
+}
+
+TEST(Tlsf, GrowsOnlyWhenAllowed) {
+    Backends::Tlsf fixed{Backends::Tlsf::Options{.pool_size = 1 << 16}};
+    EXPECT_THROW(fixed.allocate(1 << 17), std::bad_alloc);
+    Backends::Tlsf growing{Backends::Tlsf::Options{.pool_size = 1 << 16, .grow = true}};
+    EXPECT_NE(growing.allocate(1 << 17), nullptr);
+    EXPECT_GE(growing.reserved(), size_t{1} << 17);
+    // Not on a list boundary, the grown pool still has to fit it after the search rounds it up.
+    EXPECT_NE(growing.allocate(55244549), nullptr);
+}
+
+TEST(Tlsf, LazyPoolIsMappedOnFirstAllocation) {
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = 1 << 20, .lazy = true}};
+    EXPECT_EQ(backend.reserved(), 0u);
+    EXPECT_NE(backend.allocate(100), nullptr);
+    EXPECT_EQ(backend.reserved(), size_t{1} << 20);
+}
+
+TEST(Tlsf, AlignedAllocationsStayAlignedAndMergeBack) {
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    std::vector<void*> blocks;
+    for (size_t alignment = 32; alignment <= 65536; alignment *= 2) {
+        void * memory = backend.allocate_aligned(100, alignment);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(memory) % alignment, 0u);
+        EXPECT_GE(backend.usable_size(memory), 100u);
+        blocks.push_back(memory);
+    }
+    for (void * block : blocks) {
+        backend.free(block);
+    }
+    EXPECT_NE(backend.allocate(900000), nullptr);
+}
+
+TEST(Buddy, ChurnKeepsBlocksApart) {
+    Backends::Buddy backend{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = 64 << 20}};
+    auto power_of_two = [](std::mt19937& rng) -> size_t { return size_t{4096} << (rng() % 9); };
+    churn(backend, power_of_two, 5000, 4096);
+}
+
+TEST(Buddy, MergesBackToRoots) {
+    Backends::Buddy backend{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = 1 << 20}};
+    std::vector<void*> blocks;
+    for (int i = 0; i < 256; ++i) {
+        blocks.push_back(backend.allocate(4096));
+    }
+    EXPECT_THROW(backend.allocate(4096), std::bad_alloc);
+    for (void * block : blocks) {
+        backend.free(block);
+    }
+    EXPECT_NE(backend.allocate(1 << 20), nullptr);
+}
+
+TEST(Buddy, SizedFreesMergeLikeFrees) {
+    Backends::Buddy backend{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = 1 << 20}};
+    std::vector<void*> blocks;
+    for (int i = 0; i < 128; ++i) {
+        blocks.push_back(backend.allocate(5000));
+    }
+    for (void * block : blocks) {
+        EXPECT_TRUE(backend.free_sized(block, 5000));
+    }
+    EXPECT_NE(backend.allocate(1 << 20), nullptr);
+}
+
+TEST(Buddy, RefusesMemoryItDidntHandOut) {
+    Backends::Buddy backend{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = 1 << 20}};
+    void * first = backend.allocate(8192);
+    void * second = backend.allocate(8192);
+    int local = 0;
+    EXPECT_FALSE(backend.free(&local));
+    EXPECT_FALSE(backend.free(static_cast<unsigned char*>(second) + 16));
+    EXPECT_FALSE(backend.free(static_cast<unsigned char*>(second) + 4096));
+    EXPECT_TRUE(backend.free(second));
+    EXPECT_FALSE(backend.free(second));
+    EXPECT_TRUE(backend.free(first));
+    EXPECT_FALSE(backend.free(first));
+    // Past what was ever committed.
+    backend.free_all();
+    EXPECT_FALSE(backend.free(first));
+    EXPECT_NE(backend.allocate(1 << 20), nullptr);
+}
+
+TEST(Buddy, CommitsRootsOnDemand) {
+    Backends::Buddy backend{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = size_t{16} << 30}};
+    EXPECT_EQ(backend.reserved(), 0u);
+    backend.allocate(4096);
+    EXPECT_EQ(backend.reserved(), size_t{1} << 20);
+}
+
+TEST(Slab, ChurnKeepsBlocksApart) {
+    Backends::Slab backend;
+    churn(backend, small_or_large, 20000, 16);
+}
+
+TEST(Slab, ReusesFreedObjectsOfTheSameClass) {
+    Backends::Slab backend;
+    void * first = backend.allocate(100);
+    backend.free(first);
+    EXPECT_EQ(backend.allocate(100), first);
+    EXPECT_EQ(backend.usable_size(first), DefaultSizeClasses::class_size(100));
+}
+
+TEST(Slab, SizedFreesGoStraightToTheirClass) {
+    Backends::Slab backend;
+    for (size_t size : {0u, 1u, 100u, 5000u, 40000u, 1u << 20}) {
+        void * memory = backend.allocate(size);
+        EXPECT_TRUE(backend.free_sized(memory, size)) << size;
+        EXPECT_EQ(backend.allocate(size), memory) << size;
+    }
+}
+
+TEST(Slab, CatchesWrongSizes) {
+    Backends::Slab backend;
+    void * small = backend.allocate(16);
+    void * large = backend.allocate(1 << 20);
+    alignas(16) unsigned char local[64] = {};
+    EXPECT_FALSE(backend.free_sized(small, 4000));
+    EXPECT_FALSE(backend.free_sized(local, 16));
+    EXPECT_FALSE(backend.free_sized(local, 1 << 20));
+    EXPECT_TRUE(backend.free_sized(small, 16));
+    EXPECT_TRUE(backend.free_sized(large, 1 << 20));
+}
+
+TEST(Slab, RefusesMemoryItDidntHandOut) {
+    Backends::Slab backend;
+    auto * first = static_cast<unsigned char*>(backend.allocate(100));
+    auto * second = static_cast<unsigned char*>(backend.allocate(100));
+    size_t const size = backend.usable_size(first);
+    alignas(16) unsigned char local[64] = {};
+    EXPECT_FALSE(backend.free(local + 32));
+    EXPECT_FALSE(backend.free(second + 16));
+    // Never handed out: the rest of the newest run, and committed pages no run was cut from yet.
+    EXPECT_FALSE(backend.free(second + size));
+    EXPECT_FALSE(backend.free(first + (size_t{512} << 10)));
+    EXPECT_TRUE(backend.free(second));
+    EXPECT_FALSE(backend.free(second));
+    EXPECT_FALSE(backend.free_sized(second, 100));
+    EXPECT_TRUE(backend.free(first));
+    // The list holds each object once.
+    void * again = backend.allocate(100);
+    void * other = backend.allocate(100);
+    EXPECT_NE(again, other);
+    EXPECT_EQ(backend.allocate(100), second + size);
+}
+
+TEST(Slab, AlignedAllocationsPickAnAlignedClass) {
+    Backends::Slab backend;
+    for (size_t alignment : {32u, 64u, 256u, 4096u, 8192u}) {
+        for (size_t size : {1u, 100u, 5000u, 40000u}) {
+            void * memory = backend.allocate_aligned(size, alignment);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(memory) % alignment, 0u) << size << " at " << alignment;
+            EXPECT_GE(backend.usable_size(memory), size);
+            EXPECT_TRUE(backend.free(memory));
+        }
+    }
+}
+
+TEST(Tlsf, RefusesTheUncommittedRestOfItsReservation) {
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = 1 << 20, .reserve = size_t{1} << 30}};
+    void * memory = backend.allocate(1000);
+    // Reserved, PROT_NONE and past the only pool: reading a header there would fault.
+    void * tail = static_cast<unsigned char*>(memory) + (size_t{64} << 20);
+    EXPECT_FALSE(backend.owns(tail));
+    EXPECT_FALSE(backend.free(tail));
+    EXPECT_TRUE(backend.free(memory));
+}
+
+TEST(Arena, OwnsOnlyCommittedChunks) {
+    Backends::Arena backend{Backends::Arena::Options{.chunk_size = 1 << 16, .reserve = size_t{1} << 30}};
+    void * memory = backend.allocate(100);
+    EXPECT_TRUE(backend.owns(memory));
+    EXPECT_FALSE(backend.owns(static_cast<unsigned char*>(memory) + (size_t{64} << 20)));
+}
+
+TEST(Arena, FreeAllRewindsToTheFirstChunk) {
+    Backends::Arena backend{Backends::Arena::Options{.chunk_size = 1 << 16, .reserve = size_t{1} << 30}};
+    void * first = backend.allocate(100);
+    for (int i = 0; i < 100; ++i) {
+        backend.allocate(10000);
+    }
+    EXPECT_GT(backend.reserved(), size_t{1} << 16);
+    backend.free_all();
+    EXPECT_EQ(backend.reserved(), size_t{1} << 16);
+    EXPECT_EQ(backend.allocate(100), first);
+}
+
+TEST(Reservation, CompressesAddressesToOffsets) {
+    Os::Reservation reservation{size_t{1} << 30};
+    auto * memory = static_cast<unsigned char*>(reservation.commit(1 << 16));
+    EXPECT_TRUE(reservation.contains(memory + 100));
+    EXPECT_EQ(reservation.decompress(reservation.compress(memory + 4096)), memory + 4096);
+    reservation.decommit(memory, 1 << 16);
+    EXPECT_EQ(reservation.committed(), 0u);
+}
+
+TEST(Reservation, OnlySmallReservationsCompress) {
+    EXPECT_TRUE(Os::Reservation{Os::Reservation::max_compressible}.compressible());
+    Os::Reservation huge{Os::Reservation::max_compressible * 2};
+    EXPECT_FALSE(huge.compressible());
+    EXPECT_DEBUG_DEATH(huge.compress(huge.base()), "compressible");
+}
+
+TEST(Numa, InterleaveSetsThePolicyOfWholePages) {
+    size_t const size = 64 * Os::page_size();
+    void * memory = Os::map(size);
+    ASSERT_GE(Os::numa_nodes(), 1u);
+    if (not Os::interleave(static_cast<unsigned char*>(memory) + 1, size - 1)) {
+        Os::unmap(memory, size);
+        GTEST_SKIP() << "kernel without NUMA support";
+    }
+    int mode = -1;
+    void * second = static_cast<unsigned char*>(memory) + Os::page_size();
+    ASSERT_EQ(::syscall(SYS_get_mempolicy, &mode, nullptr, 0, second, MPOL_F_ADDR), 0);
+    EXPECT_EQ(mode, MPOL_INTERLEAVE);
+    // The partial first page is left alone.
+    ASSERT_EQ(::syscall(SYS_get_mempolicy, &mode, nullptr, 0, memory, MPOL_F_ADDR), 0);
+    EXPECT_EQ(mode, MPOL_DEFAULT);
+    Os::unmap(memory, size);
+}
+
+TEST(Numa, FirstTouchTouchesEveryPage) {
+    size_t const size = 16 * Os::page_size();
+    auto * memory = static_cast<unsigned char*>(Os::map(size));
+    std::memset(memory, 1, size);
+    Os::first_touch(memory, size);
+    for (size_t offset = 0; offset < size; offset += Os::page_size()) {
+        EXPECT_EQ(memory[offset], 0);
+        EXPECT_EQ(memory[offset + 1], 1);
+    }
+    Os::unmap(memory, size);
+}
+
+TEST(Prefault, PrefaultedPagesDontFault) {
+    size_t const size = 256 * Os::page_size();
+    void * memory = Os::map(size);
+    Os::prefault(memory, size);
+    EXPECT_LT(faults_touching(memory, size), fault_slack);
+    Os::unmap(memory, size);
+
+    void * populated = Os::map(size, true);
+    EXPECT_LT(faults_touching(populated, size), fault_slack);
+    Os::unmap(populated, size);
+}
+
+TEST(Prefault, PrefaultKeepsTheContents) {
+    size_t const size = 4 * Os::page_size();
+    auto * memory = static_cast<unsigned char*>(Os::map(size));
+    std::memset(memory, 0x5a, size);
+    Os::prefault(memory, size);
+    EXPECT_EQ(memory[0], 0x5a);
+    EXPECT_EQ(memory[size - 1], 0x5a);
+    Os::unmap(memory, size);
+}
+
+TEST(Prewarm, KeepsSpansReadyAndRefillsThem) {
+    Os::PrewarmPool pool{size_t{1} << 20, 2};
+    auto const wait_ready = [&pool](size_t spans) {
+        for (int i = 0; i < 500 and pool.ready() < spans; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        return pool.ready();
+    };
+    ASSERT_EQ(wait_ready(2), 2u);
+    void * span = pool.take();
+    EXPECT_LT(faults_touching(span, pool.span_size()), fault_slack);
+    EXPECT_EQ(wait_ready(2), 2u);
+    pool.give_back(span);
+    EXPECT_EQ(pool.misses(), 0u);
+}
+
+TEST(Prewarm, TlsfGrowsOutOfThePool) {
+    size_t const pool_size = size_t{1} << 20;
+    Os::PrewarmPool pool{pool_size, 2};
+    Backends::Tlsf backend{Backends::Tlsf::Options{.pool_size = pool_size, .grow = true, .prewarm = &pool}};
+    std::vector<void*> blocks;
+    while (backend.reserved() < 2 * pool_size) {
+        blocks.push_back(backend.allocate(64 << 10));
+    }
+    EXPECT_TRUE(backend.owns(blocks.back()));
+    for (void * block : blocks) {
+        backend.free(block);
+    }
+}
+
+TEST(Buddy, PopulatedRootsDontFault) {
+    Backends::Buddy backend{Backends::Buddy::Options{.max_block = size_t{1} << 20, .region_size = size_t{1} << 20, .populate = true}};
+    void * memory = backend.allocate(size_t{1} << 20);
+    EXPECT_LT(faults_touching(memory, size_t{1} << 20), fault_slack);
+    backend.free(memory);
+}
+
+namespace {
+    // Fills a block, frees it, purges and checks the same memory comes back zeroed and the backend still works.
+    template<typename Backend_>
+    void expect_purge_releases_free_blocks(Backend_& backend, size_t size) {
+        auto * memory = static_cast<unsigned char*>(backend.allocate(size));
+        std::memset(memory, 0xab, size);
+        backend.free(memory);
+        EXPECT_GE(backend.purge(), size - 2 * Os::page_size());
+        auto * again = static_cast<unsigned char*>(backend.allocate(size));
+        ASSERT_EQ(again, memory);
+        EXPECT_EQ(again[size / 2], 0);
+        backend.free(again);
+    }
+}
+
+TEST(Purge, ReleasesFreeBlocks) {
+    Backends::Tlsf tlsf{Backends::Tlsf::Options{.pool_size = size_t{4} << 20}};
+    expect_purge_releases_free_blocks(tlsf, size_t{1} << 20);
+    Backends::Buddy buddy{Backends::Buddy::Options{.max_block = size_t{1} << 20, .region_size = size_t{4} << 20}};
+    expect_purge_releases_free_blocks(buddy, size_t{1} << 20);
+}
+
+TEST(Purge, SlabReleasesWhatRunsDidntHandOut) {
+    Backends::Slab slab;
+    void * object = slab.allocate(64);
+    EXPECT_GT(slab.purge(), 0u);
+    EXPECT_NE(slab.allocate(64), object);
+}
+
+TEST(Prewarm, DrainUnmapsUntilTheNextTake) {
+    Os::PrewarmPool pool{size_t{1} << 20, 2};
+    for (int i = 0; i < 500 and pool.ready() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_EQ(pool.ready(), 2u);
+    EXPECT_EQ(pool.drain(), 2 * pool.span_size());
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    EXPECT_EQ(pool.ready(), 0u);
+    pool.give_back(pool.take());
+    for (int i = 0; i < 500 and pool.ready() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    EXPECT_EQ(pool.ready(), 2u);
+}
+
+namespace {
+    // Just enough of an io_uring to run one request at a time, the pool is meant for the application's own ring.
+    class TestRing {
+        public:
+        TestRing() {
+            io_uring_params params{};
+            m_Fd = static_cast<int>(::syscall(SYS_io_uring_setup, 4, &params));
+            if (m_Fd < 0) {
+                return;
+            }
+            m_SqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            m_CqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            m_Sq = static_cast<unsigned char*>(::mmap(nullptr, m_SqSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, IORING_OFF_SQ_RING));
+            m_Cq = static_cast<unsigned char*>(::mmap(nullptr, m_CqSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, IORING_OFF_CQ_RING));
+            m_Sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, IORING_OFF_SQES));
+            m_Entries = params.sq_entries;
+            m_Params = params;
+        }
+        ~TestRing() {
+            if (m_Fd >= 0) {
+                ::munmap(m_Sq, m_SqSize);
+                ::munmap(m_Cq, m_CqSize);
+                ::munmap(m_Sqes, m_Entries * sizeof(io_uring_sqe));
+                ::close(m_Fd);
+            }
+        }
+
+        int fd() const { return m_Fd; }
+
+        // Submits what `fill` puts in an SQE and waits for its result.
+        template<typename Fill_>
+        int run(Fill_ const& fill) {
+            auto * tail = reinterpret_cast<std::atomic<uint32_t>*>(m_Sq + m_Params.sq_off.tail);
+            uint32_t const mask = *reinterpret_cast<uint32_t*>(m_Sq + m_Params.sq_off.ring_mask);
+            uint32_t const at = tail->load(std::memory_order_relaxed);
+            fill(m_Sqes[at & mask]);
+            reinterpret_cast<uint32_t*>(m_Sq + m_Params.sq_off.array)[at & mask] = at & mask;
+            tail->store(at + 1, std::memory_order_release);
+            if (::syscall(SYS_io_uring_enter, m_Fd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+                return -errno;
+            }
+            auto * head = reinterpret_cast<std::atomic<uint32_t>*>(m_Cq + m_Params.cq_off.head);
+            uint32_t const cq_mask = *reinterpret_cast<uint32_t*>(m_Cq + m_Params.cq_off.ring_mask);
+            uint32_t const done = head->load(std::memory_order_relaxed);
+            int const result = reinterpret_cast<io_uring_cqe*>(m_Cq + m_Params.cq_off.cqes)[done & cq_mask].res;
+            head->store(done + 1, std::memory_order_release);
+            return result;
+        }
+
+        private:
+        int m_Fd = -1;
+        io_uring_params m_Params{};
+        unsigned char * m_Sq = nullptr;
+        unsigned char * m_Cq = nullptr;
+        io_uring_sqe * m_Sqes = nullptr;
+        size_t m_SqSize = 0;
+        size_t m_CqSize = 0;
+        uint32_t m_Entries = 0;
+    };
+}
+
+TEST(FixedBuffers, SlicesAreRecycledAndPageAligned) {
+    Io::FixedBuffers pool{Io::FixedBuffers::Options{.slice_size = 1000, .slices = 2}};
+    EXPECT_EQ(pool.slice_size(), Os::page_size());
+    auto first = pool.take();
+    auto second = pool.take();
+    ASSERT_TRUE(first and second);
+    EXPECT_NE(first.index(), second.index());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(second.data()) % Os::page_size(), 0u);
+    EXPECT_FALSE(pool.take());
+    uint16_t const index = first.index();
+    first.reset();
+    EXPECT_EQ(pool.available(), 1u);
+    auto again = pool.take();
+    EXPECT_EQ(again.index(), index);
+}
+
+TEST(FixedBuffers, RegionComesFromTheGivenHeap) {
+    Heap heap;
+    void * base = nullptr;
+    {
+        Io::FixedBuffers pool{Io::FixedBuffers::Options{.slice_size = 4096, .slices = 2}, HeapHandle{heap}};
+        auto slice = pool.take();
+        base = slice.data();
+        EXPECT_TRUE(heap.owns(base));
+    }
+    EXPECT_FALSE(heap.owns(base));
+}
+
+TEST(FixedBuffers, RefusesLengthsPastTheSlice) {
+    Io::FixedBuffers pool{Io::FixedBuffers::Options{.slice_size = 4096, .slices = 1}};
+    auto slice = pool.take();
+    io_uring_sqe sqe{};
+    sqe.user_data = 42;
+    EXPECT_FALSE(slice.read_fixed(sqe, 0, 0, slice.size() + 1));
+    EXPECT_FALSE(slice.write_fixed(sqe, 0, 0, slice.size() + 1));
+    EXPECT_EQ(sqe.user_data, 42u);
+    EXPECT_TRUE(slice.write_fixed(sqe, 0, 0, slice.size()));
+    EXPECT_EQ(sqe.len, slice.size());
+}
+
+TEST(FixedBuffers, FixedReadsAndWritesGoThroughRegisteredSlices) {
+    TestRing ring;
+    if (ring.fd() < 0) {
+        GTEST_SKIP() << "no io_uring here";
+    }
+    Io::FixedBuffers pool{Io::FixedBuffers::Options{.slice_size = 4096, .slices = 4}};
+    ASSERT_TRUE(pool.register_with(ring.fd())) << std::strerror(errno);
+
+    char path[] = "/tmp/passivegc_fixed_XXXXXX";
+    int const file = ::mkstemp(path);
+    ASSERT_GE(file, 0);
+    ::unlink(path);
+
+    auto out = pool.take();
+    std::memset(out.data(), 'x', out.size());
+    EXPECT_EQ(ring.run([&](io_uring_sqe& sqe) { EXPECT_TRUE(out.write_fixed(sqe, file, 4096, out.size())); }), 4096);
+    auto in = pool.take();
+    EXPECT_NE(in.index(), out.index());
+    EXPECT_EQ(ring.run([&](io_uring_sqe& sqe) { EXPECT_TRUE(in.read_fixed(sqe, file, 4096, in.size())); }), 4096);
+    EXPECT_EQ(std::memcmp(in.data(), out.data(), in.size()), 0);
+    ::close(file);
+    pool.unregister();
+}
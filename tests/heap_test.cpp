@@ -0,0 +1,787 @@
+#include "MemManage.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace AutomaticMemory;
+
+namespace {
+    struct Counted {
+        Counted() { ++alive; }
+        Counted(int value) : value{value} { ++alive; }
+        ~Counted() { --alive; }
+        int value = 0;
+        inline static int alive = 0;
+    };
+
+    // Throws from the fail_at-th construction on. Safe to construct and destroy concurrently.
+    struct Fragile {
+        Fragile() {
+            if (++constructions >= fail_at) {
+                throw std::runtime_error{"fragile"};
+            }
+            ++alive;
+        }
+        ~Fragile() { --alive; }
+        inline static std::atomic<int> constructions = 0;
+        inline static std::atomic<int> alive = 0;
+        inline static int fail_at = 0;
+    };
+
+    // Fixed thread count, so the arrays get split even on a single core machine.
+    using ParallelHeap = BasicHeap<Backends::Segments, Policies::SingleThreaded, Policies::BasicStats, Policies::ThrowOnError, Policies::ParallelConstruction<1000, 4>>;
+}
+
+TEST(Heap, AllocateConstructedForwardsArguments) {
+    Heap heap;
+    auto pointer = heap.allocate_constructed<Counted>(42);
+    EXPECT_EQ(pointer->value, 42);
+    EXPECT_EQ((*pointer).value, 42);
+}
+
+TEST(Heap, PointerDestroysAndFreesAtEndOfScope) {
+    Heap heap;
+    {
+        auto pointer = heap.allocate_constructed<Counted>();
+        EXPECT_EQ(Counted::alive, 1);
+        EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), sizeof(Counted));
+    }
+    EXPECT_EQ(Counted::alive, 0);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Heap, MovedPointerKeepsOwnership) {
+    Heap heap;
+    auto make = [&] {
+        auto pointer = heap.allocate_constructed<Counted>(7);
+        return pointer;
+    };
+    {
+        auto pointer = make();
+        EXPECT_EQ(pointer->value, 7);
+        EXPECT_EQ(Counted::alive, 1);
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TEST(Heap, ArrayConstructsAndDestroysEveryElement) {
+    Heap heap;
+    {
+        auto array = heap.allocate_constructed_n<Counted>(100, 3);
+        EXPECT_EQ(Counted::alive, 100);
+        for (size_t i = 0; i < 100; ++i) {
+            EXPECT_EQ(array[i].value, 3);
+        }
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TEST(Heap, FailedConstructionKeepsTheConstructedPrefix) {
+    Heap heap;
+    Fragile::constructions = 0;
+    Fragile::fail_at = 10;
+    {
+        auto array = heap.allocate_constructed_n<Fragile>(100);
+        EXPECT_EQ(array.Error().error_code(), -2);
+        array.Error().dont_exit();
+        EXPECT_EQ(Fragile::alive, 9);
+    }
+    EXPECT_EQ(Fragile::alive, 0);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Heap, ParallelConstructionBuildsAndDestroysEveryElement) {
+    ParallelHeap heap;
+    Fragile::constructions = 0;
+    Fragile::fail_at = 1 << 30;
+    {
+        auto array = heap.allocate_constructed_n<Fragile>(100000);
+        EXPECT_EQ(Fragile::alive, 100000);
+        auto numbers = heap.allocate_constructed_n<std::vector<int>>(50000, 3, 7);
+        for (size_t i = 0; i < 50000; ++i) {
+            ASSERT_EQ(numbers[i], (std::vector<int>{7, 7, 7}));
+        }
+    }
+    EXPECT_EQ(Fragile::alive, 0);
+}
+
+TEST(Heap, ParallelConstructionFailureRollsBackToAPrefix) {
+    ParallelHeap heap;
+    Fragile::constructions = 0;
+    Fragile::fail_at = 70000;
+    {
+        auto array = heap.allocate_constructed_n<Fragile>(100000);
+        EXPECT_EQ(array.Error().error_code(), -2);
+        array.Error().dont_exit();
+        EXPECT_LT(Fragile::alive, 100000);
+    }
+    EXPECT_EQ(Fragile::alive, 0);
+}
+
+namespace {
+    // Runs for_chunks with no room left for another thread's stack, so every std::thread fails to start.
+    [[noreturn]] void for_chunks_without_threads() {
+        std::ifstream statm{"/proc/self/statm"};
+        size_t pages = 0;
+        statm >> pages;
+        rlimit const limit{pages * Os::page_size() + (size_t{1} << 20), RLIM_INFINITY};
+        ::setrlimit(RLIMIT_AS, &limit);
+        std::vector<std::atomic<int>> done(64);
+        Parallel::for_chunks(done.size(), 8, [&done](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                ++done[i];
+            }
+        });
+        bool const once = std::all_of(done.begin(), done.end(), [](std::atomic<int> const& count) { return count == 1; });
+        std::_Exit(once ? 0 : 1);
+    }
+}
+
+TEST(Parallel, ChunksThatGetNoThreadRunOnTheCaller) {
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+    GTEST_SKIP() << "Sanitizers reserve more address space than the limit leaves.";
+#endif
+    EXPECT_EXIT(for_chunks_without_threads(), testing::ExitedWithCode(0), "");
+}
+
+TEST(Heap, SubscriptChecksTheLastIndex) {
+    Heap heap;
+    auto array = heap.allocate_constructed_n<int>(4, 1);
+    EXPECT_EQ(array[3], 1);
+    EXPECT_TRUE(array.Error().what().empty());
+    // One past the end used to slip through.
+    array[4];
+    EXPECT_EQ(array.Error().error_code(), -3);
+    array.Error().dont_exit();
+}
+
+TEST(Heap, ManyLivePointersSurviveEachOther) {
+    Heap heap;
+    std::vector<std::optional<Heap::Pointer<int, false>>> pointers;
+    for (int i = 0; i < 1000; ++i) {
+        pointers.emplace_back(heap.allocate_constructed<int>(i));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        pointers[i].reset();
+    }
+    for (int i = 1; i < 1000; i += 2) {
+        EXPECT_EQ(**pointers[i], i);
+    }
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 500 * sizeof(int));
+}
+
+TEST(Heap, StatsStartAtZero) {
+    Heap heap;
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+    EXPECT_FLOAT_EQ(heap.peak_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Heap, StatsTrackPeak) {
+    Heap heap;
+    {
+        auto a = heap.allocate_constructed_n<char>(1000);
+        auto b = heap.allocate_constructed_n<char>(1000);
+    }
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+    EXPECT_FLOAT_EQ(heap.peak_memory(SizeTypes::Byte), 2000);
+}
+
+TEST(Heap, NoStatsReportsNothing) {
+    BasicHeap<Backends::Segments, Policies::SingleThreaded, Policies::NoStats> heap;
+    auto pointer = heap.allocate_constructed_n<char>(1000);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Heap, NullOnErrorReturnsEmptyPointer) {
+    BasicHeap<Backends::Tlsf, Policies::SingleThreaded, Policies::BasicStats, Policies::NullOnError> heap{Backends::Tlsf::Options{.pool_size = 1 << 16}};
+    auto pointer = heap.allocate_constructed_n<char>(1 << 20);
+    EXPECT_EQ(pointer.Error().error_code(), -4);
+    pointer.Error().dont_exit();
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Heap, ThrowOnErrorThrowsBadAlloc) {
+    TlsfHeap heap{Backends::Tlsf::Options{.pool_size = 1 << 16}};
+    EXPECT_THROW(heap.allocate_constructed_n<char>(1 << 20), std::bad_alloc);
+}
+
+TEST(Heap, SizedFreesKeepTheStats) {
+    SlabHeap heap;
+    HeapHandle handle{heap};
+    void * memory = handle.allocate(100);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 100);
+    heap.free_sized(memory, 100);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+    EXPECT_EQ(handle.allocate(100), memory);
+}
+
+TEST(Heap, AlignedPointersAreNotFreedBySize) {
+    SlabHeap heap;
+    void * address;
+    {
+        // Lands in a bigger class than 100 bytes would, freeing by size would put it on the wrong list.
+        auto buffer = heap.allocate_uninitialized_n<char>(100, 4096);
+        address = &buffer[0];
+    }
+    auto again = heap.allocate_uninitialized_n<char>(100, 4096);
+    EXPECT_EQ(&again[0], address);
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 100);
+}
+
+TEST(Heap, WrongSizesAreInvalidFrees) {
+    SlabHeap heap;
+    HeapHandle handle{heap};
+    void * memory = handle.allocate(16);
+    EXPECT_THROW(heap.free_sized(memory, 4000), std::bad_alloc);
+    heap.free_sized(memory, 16);
+}
+
+TEST(Heap, OwnsOnlyItsOwnMemory) {
+    TlsfHeap heap{Backends::Tlsf::Options{.pool_size = 1 << 20, .reserve = size_t{1} << 30}};
+    auto pointer = heap.allocate_constructed<int>(1);
+    int local = 0;
+    EXPECT_TRUE(heap.owns(&*pointer));
+    EXPECT_FALSE(heap.owns(&local));
+}
+
+namespace {
+    // Initialized before the global heap's translation unit and destroyed after it, the test binary links first.
+    AutomaticMemory::string const global_text(200, 'g');
+}
+
+TEST(Allocator, GlobalsOutliveTheGlobalHeap) {
+    // The real check is at exit: destroying global_text must not touch a destroyed heap.
+    EXPECT_EQ(global_text.size(), 200u);
+    EXPECT_TRUE(heap.owns(const_cast<char*>(global_text.data())));
+}
+
+TEST(Allocator, ContainersUseTheGlobalHeap) {
+    float const before = heap.used_memory(SizeTypes::Byte);
+    {
+        AutomaticMemory::vector<int> numbers;
+        for (int i = 0; i < 1000; ++i) {
+            numbers.push_back(i);
+        }
+        AutomaticMemory::string text(200, 'x');
+        EXPECT_EQ(numbers[999], 999);
+        EXPECT_EQ(text.size(), 200u);
+        EXPECT_GT(heap.used_memory(SizeTypes::Byte), before);
+    }
+    EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), before);
+}
+
+TEST(Allocator, ForeignDeallocateThrows) {
+    Allocator<int> allocator;
+    int local = 0;
+    EXPECT_THROW(allocator.deallocate(&local, 1), std::bad_alloc);
+}
+
+TEST(Placement, PlacedArraysAreConstructedAsUsual) {
+    size_t const count = placement_threshold / sizeof(int) + 1;
+    for (Placement placement : {Placement::Local, Placement::Interleave, Placement::FirstTouch}) {
+        auto numbers = heap.allocate_constructed_n<int>(placement, count, 7);
+        EXPECT_EQ(numbers[0], 7);
+        EXPECT_EQ(numbers[count - 1], 7);
+    }
+}
+
+TEST(Placement, AllocatorKeepsItsPlacementAcrossRebinds) {
+    Allocator<double> allocator{Placement::Interleave};
+    Allocator<char> rebound{allocator};
+    EXPECT_EQ(rebound.placement(), Placement::Interleave);
+    EXPECT_TRUE(rebound == allocator);
+
+    AutomaticMemory::vector<double> values(placement_threshold / sizeof(double), 1.5, allocator);
+    EXPECT_EQ(values.get_allocator().placement(), Placement::Interleave);
+    EXPECT_EQ(values.back(), 1.5);
+}
+
+TEST(Prefault, FlagsReachTheAllocatorAndTheHeap) {
+    auto bytes = heap.allocate_constructed_n<char>(AllocationFlags::Prefault, size_t{1} << 20, 'x');
+    EXPECT_EQ(bytes[(size_t{1} << 20) - 1], 'x');
+
+    Allocator<int> allocator{Placement::Interleave, AllocationFlags::Prefault};
+    Allocator<long> rebound{allocator};
+    EXPECT_TRUE(has(rebound.flags(), AllocationFlags::Prefault));
+    AutomaticMemory::vector<int> numbers(1 << 18, 3, allocator);
+    EXPECT_EQ(numbers.back(), 3);
+}
+
+TEST(HeapScope, ContainersBuiltInsideUseTheScopedHeap) {
+    ArenaHeap arena;
+    float const global_before = heap.used_memory(SizeTypes::Byte);
+    {
+        HeapScope scope{arena};
+        AutomaticMemory::vector<int> numbers(1000, 1);
+        AutomaticMemory::string text(200, 'x');
+        EXPECT_TRUE(arena.owns(numbers.data()));
+        EXPECT_TRUE(arena.owns(text.data()));
+        EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), global_before);
+    }
+    EXPECT_EQ(current_heap(), HeapHandle{});
+    arena.free_all();
+}
+
+TEST(HeapScope, MemoryGoesBackToTheHeapItCameFrom) {
+    TlsfHeap outer{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    TlsfHeap inner{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    HeapScope outer_scope{outer};
+    AutomaticMemory::vector<int> built_outside;
+    {
+        HeapScope inner_scope{inner};
+        EXPECT_EQ(current_heap(), HeapHandle{inner});
+        AutomaticMemory::vector<int> built_inside(100, 2);
+        // Grows from the heap it was built with, not the current one.
+        built_outside.assign(100, 1);
+        EXPECT_TRUE(outer.owns(built_outside.data()));
+        EXPECT_TRUE(inner.owns(built_inside.data()));
+        EXPECT_FALSE(built_inside.get_allocator() == built_outside.get_allocator());
+    }
+    EXPECT_EQ(current_heap(), HeapHandle{outer});
+    // Freed after the inner scope ended, still to inner.
+    built_outside.clear();
+    built_outside.shrink_to_fit();
+    EXPECT_FLOAT_EQ(outer.used_memory(SizeTypes::Byte), 0);
+    EXPECT_FLOAT_EQ(inner.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(HeapScope, ScopesAreThreadLocal) {
+    ArenaHeap arena;
+    HeapScope scope{arena};
+    HeapHandle seen{arena};
+    std::thread{[&seen] { seen = current_heap(); }}.join();
+    EXPECT_EQ(seen, HeapHandle{});
+}
+
+namespace {
+    struct Accounted {
+        char bytes[48];
+    };
+
+    Accounting::Entry entry_for(Accounting::Kind kind, std::string_view name) {
+        for (Accounting::Entry const& entry : Accounting::snapshot()) {
+            if (entry.kind == kind and entry.name == name) {
+                return entry;
+            }
+        }
+        return Accounting::Entry{kind, std::string{name}};
+    }
+
+    using AccountedHeap = BasicHeap<Backends::Tlsf, Policies::Locked, Policies::AccountedStats>;
+}
+
+TEST(Accounting, TypeNamesAreReadable) {
+    EXPECT_EQ(Accounting::type_name<int>(), "int");
+    // Compilers spell the anonymous namespace differently, only the tail is portable.
+    EXPECT_TRUE(std::string_view{Accounting::type_name<Accounted>()}.ends_with("::Accounted"));
+    // GCC puts a space before the brackets, Clang doesn't.
+    EXPECT_TRUE(Accounting::type_name<int[4]>().ends_with("[4]"));
+    EXPECT_TRUE(Accounting::type_name<int[2][3]>().ends_with("[2][3]"));
+    EXPECT_NE(Accounting::type_name<int[4]>(), Accounting::type_name<int[8]>());
+}
+
+TEST(Accounting, ChargesAllocationsToTheirType) {
+    AccountedHeap heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto const type = Accounting::type_key<Accounted>();
+    auto const before = entry_for(type.kind, type.name);
+    {
+        auto one = heap.allocate_constructed<Accounted>();
+        auto many = heap.allocate_constructed_n<Accounted>(10);
+        auto const live = entry_for(type.kind, type.name);
+        EXPECT_EQ(live.live_bytes - before.live_bytes, static_cast<int64_t>(11 * sizeof(Accounted)));
+        EXPECT_EQ(live.live_count - before.live_count, 2);
+    }
+    auto const after = entry_for(type.kind, type.name);
+    EXPECT_EQ(after.live_bytes, before.live_bytes);
+    EXPECT_EQ(after.allocations - before.allocations, 2u);
+}
+
+TEST(Accounting, TagsFollowRebindsAndMergeAcrossThreads) {
+    AccountedHeap heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    HeapScope scope{heap};
+    Allocator<int> const tagged{Accounting::tag("accounting-test")};
+    Allocator<long> const rebound{tagged};
+    EXPECT_EQ(rebound.key().name, "accounting-test");
+
+    std::optional<AutomaticMemory::vector<int>> numbers{std::in_place, tagged};
+    numbers->assign(100, 1);
+    std::thread{[&numbers] {
+        // Freed on another thread, charged back to that thread's shard.
+        numbers.reset();
+    }}.join();
+    auto const tag = entry_for(Accounting::Kind::Tag, "accounting-test");
+    EXPECT_EQ(tag.live_bytes, 0);
+    EXPECT_EQ(tag.live_count, 0);
+    EXPECT_EQ(tag.allocations, 1u);
+}
+
+namespace {
+    struct LeftForFreeAll {
+        char bytes[24];
+    };
+}
+
+TEST(Accounting, FreeAllCreditsWhatWasStillLive) {
+    BasicHeap<Backends::Arena, Policies::Locked, Policies::AccountedStats> arena;
+    auto const type = Accounting::type_key<LeftForFreeAll>();
+    {
+        HeapScope scope{arena};
+        Allocator<int>{Accounting::tag("free-all-test")}.allocate(100);
+        Allocator<LeftForFreeAll>{}.allocate(3);
+        Allocator<LeftForFreeAll>{}.allocate(1);
+    }
+    EXPECT_EQ(entry_for(Accounting::Kind::Tag, "free-all-test").live_bytes, static_cast<int64_t>(100 * sizeof(int)));
+    EXPECT_EQ(entry_for(type.kind, type.name).live_count, 2);
+    arena.free_all();
+    for (auto const& entry : {entry_for(Accounting::Kind::Tag, "free-all-test"), entry_for(type.kind, type.name)}) {
+        EXPECT_EQ(entry.live_bytes, 0) << entry.name;
+        EXPECT_EQ(entry.live_count, 0) << entry.name;
+    }
+}
+
+namespace {
+    template<typename Heap_>
+    std::vector<Walk::Block> live_blocks(Heap_& heap) {
+        std::vector<Walk::Block> blocks;
+        heap.walk([&blocks](Walk::Span const& span) {
+            for (Walk::Block const& block : span.blocks) {
+                EXPECT_GE(block.address, span.base);
+                EXPECT_LE(static_cast<unsigned char*>(block.address) + block.size, static_cast<unsigned char*>(span.base) + span.size);
+                blocks.push_back(block);
+            }
+        });
+        return blocks;
+    }
+
+    template<typename Heap_>
+    void expect_walk_finds_exactly_the_live_blocks(Heap_& heap) {
+        std::vector<void*> kept;
+        std::vector<void*> freed;
+        for (size_t i = 0; i < 200; ++i) {
+            Allocator<char> allocator{HeapHandle{heap}};
+            char * memory = allocator.allocate(16 + i * 40);
+            if (i % 3 == 0) {
+                allocator.deallocate(memory, 16 + i * 40);
+                freed.push_back(memory);
+            } else {
+                kept.push_back(memory);
+            }
+        }
+        std::vector<void*> found;
+        for (Walk::Block const& block : live_blocks(heap)) {
+            found.push_back(block.address);
+        }
+        std::sort(found.begin(), found.end());
+        std::sort(kept.begin(), kept.end());
+        EXPECT_EQ(found, kept);
+        heap.free_all();
+    }
+}
+
+TEST(Walk, FindsExactlyTheLiveBlocks) {
+    TlsfHeap tlsf{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    expect_walk_finds_exactly_the_live_blocks(tlsf);
+    BuddyHeap buddy{Backends::Buddy::Options{.region_size = size_t{64} << 20}};
+    expect_walk_finds_exactly_the_live_blocks(buddy);
+    SlabHeap slab;
+    expect_walk_finds_exactly_the_live_blocks(slab);
+    BasicHeap<Backends::Segments, Policies::SingleThreaded, Policies::BasicStats, Policies::ThrowOnError> segments;
+    expect_walk_finds_exactly_the_live_blocks(segments);
+}
+
+TEST(Walk, SampledBlocksCarryTheirKeyAndSite) {
+    BasicHeap<Backends::Tlsf, Policies::Locked, Policies::BasicAccountedStats<1>> heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto object = heap.allocate_constructed<Accounted>();
+    size_t sampled = 0;
+    for (Walk::Block const& block : live_blocks(heap)) {
+        ASSERT_TRUE(block.sample);
+        EXPECT_EQ(block.sample->key.name, Accounting::type_name<Accounted>());
+        EXPECT_GT(block.sample->depth, 0u);
+        ++sampled;
+    }
+    EXPECT_EQ(sampled, 1u);
+}
+
+TEST(Walk, VisitorsMayAllocateFromTheWalkedHeap) {
+    BasicHeap<Backends::Tlsf, Policies::Locked, Policies::BasicStats, Policies::ThrowOnError> heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto object = heap.allocate_constructed<Accounted>();
+    size_t spans = 0;
+    heap.walk([&heap, &spans](Walk::Span const&) {
+        auto more = heap.allocate_constructed<Accounted>();
+        ++spans;
+    });
+    EXPECT_EQ(spans, 1u);
+}
+
+TEST(Walk, DumpsReadBack) {
+    BasicHeap<Backends::Tlsf, Policies::Locked, Policies::BasicAccountedStats<1>> heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto objects = heap.allocate_constructed_n<Accounted>(4);
+    std::string const path = testing::TempDir() + "walk_dump.txt";
+    ASSERT_TRUE(heap.dump(path));
+    std::ifstream file{path};
+    auto const spans = Walk::read_dump(file);
+    ASSERT_TRUE(spans);
+    ASSERT_EQ(spans->size(), 1u);
+    ASSERT_EQ(spans->front().blocks.size(), 1u);
+    Walk::DumpedBlock const& block = spans->front().blocks.front();
+    EXPECT_EQ(block.address, reinterpret_cast<uintptr_t>(&objects[0]));
+    EXPECT_GE(block.size, 4 * sizeof(Accounted));
+    EXPECT_TRUE(block.sampled);
+    EXPECT_EQ(block.kind, Accounting::Kind::Type);
+    EXPECT_EQ(block.name, Accounting::type_name<Accounted>());
+    EXPECT_FALSE(block.frames.empty());
+    std::remove(path.c_str());
+}
+
+TEST(Walk, MalformedDumpsDontReadBack) {
+    std::istringstream bad_number{"passivegc-heap-dump 1\nspan\t7f00zz\t4096\n"};
+    EXPECT_FALSE(Walk::read_dump(bad_number));
+    std::istringstream bad_frame{"passivegc-heap-dump 1\nspan\t1000\t4096\nblock\t1000\t64\ttype\tx\t,\n"};
+    EXPECT_FALSE(Walk::read_dump(bad_frame));
+    std::istringstream not_a_dump{"span\t1000\t4096\n"};
+    EXPECT_FALSE(Walk::read_dump(not_a_dump));
+}
+
+TEST(Metrics, HistogramBucketsArePowersOfTwo) {
+    Metrics::Histogram histogram;
+    histogram.record(0);
+    histogram.record(16);
+    histogram.record(17);
+    histogram.record(32);
+    histogram.record(std::numeric_limits<uint64_t>::max() / 2);
+    EXPECT_EQ(histogram.counts[0], 2u);
+    EXPECT_EQ(histogram.counts[1], 2u);
+    EXPECT_EQ(histogram.counts[Metrics::Histogram::buckets - 1], 1u);
+    EXPECT_EQ(histogram.count, 5u);
+}
+
+TEST(Metrics, SnapshotsCoverStatsOccupancyAndLatency) {
+    BasicHeap<Backends::Slab, Policies::Locked, Policies::Timed<>> heap;
+    auto objects = heap.allocate_constructed_n<Accounted>(3);
+    auto object = heap.allocate_constructed<Accounted>();
+    Metrics::HeapMetrics const metrics = heap.metrics("slab");
+    EXPECT_EQ(metrics.name, "slab");
+    EXPECT_EQ(metrics.live_bytes, 4 * sizeof(Accounted));
+    EXPECT_EQ(metrics.allocations, 2u);
+    ASSERT_TRUE(metrics.reserved_bytes);
+    EXPECT_GT(*metrics.reserved_bytes, 0u);
+    size_t live = 0;
+    for (Metrics::Occupancy const& occupancy : metrics.size_classes) {
+        EXPECT_LE(occupancy.live, occupancy.capacity);
+        live += occupancy.live;
+    }
+    EXPECT_EQ(live, 2u);
+    ASSERT_TRUE(metrics.allocate_latency);
+    EXPECT_EQ(metrics.allocate_latency->count, 2u);
+    ASSERT_TRUE(metrics.free_latency);
+    EXPECT_EQ(metrics.free_latency->count, 0u);
+}
+
+TEST(Metrics, RendersOpenMetricsToAFile) {
+    BasicHeap<Backends::Tlsf, Policies::Locked, Policies::Timed<>> heap{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    heap.allocate_constructed<Accounted>();
+    std::vector<Metrics::HeapMetrics> heaps{heap.metrics("tlsf\"1")};
+    std::string const text = Metrics::render(heaps);
+    EXPECT_NE(text.find("passivegc_live_bytes{heap=\"tlsf\\\"1\"} 0\n"), std::string::npos);
+    EXPECT_NE(text.find("passivegc_frees_total{heap=\"tlsf\\\"1\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("passivegc_allocate_latency_seconds_bucket{heap=\"tlsf\\\"1\",le=\"+Inf\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE passivegc_os_commits counter\n"), std::string::npos);
+    EXPECT_EQ(text.substr(text.size() - 6), "# EOF\n");
+
+    std::string const path = testing::TempDir() + "metrics.txt";
+    ASSERT_TRUE(Metrics::write_file(path, text));
+    std::ifstream file{path};
+    std::string const written{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    EXPECT_EQ(written, text);
+    EXPECT_FALSE(std::ifstream{path + ".tmp"}.is_open());
+    std::remove(path.c_str());
+}
+
+TEST(Metrics, SamplesFollowTheirOwnFamily) {
+    Metrics::HeapMetrics heap;
+    heap.name = "slab";
+    heap.size_classes = {{.size = 32, .live = 3, .capacity = 8}, {.size = 64, .live = 1, .capacity = 4}};
+    std::vector<Metrics::HeapMetrics> heaps{heap};
+    std::string const text = Metrics::render(heaps);
+    size_t const live_type = text.find("# TYPE passivegc_size_class_live_objects gauge\n");
+    size_t const live = text.find("passivegc_size_class_live_objects{heap=\"slab\",size=\"64\"} 1\n");
+    size_t const capacity_type = text.find("# TYPE passivegc_size_class_capacity_objects gauge\n");
+    size_t const capacity = text.find("passivegc_size_class_capacity_objects{heap=\"slab\",size=\"32\"} 8\n");
+    ASSERT_NE(capacity, std::string::npos);
+    EXPECT_LT(live_type, live);
+    EXPECT_LT(live, capacity_type);
+    EXPECT_LT(capacity_type, capacity);
+}
+
+namespace {
+    void write_events(std::string const& path, int high) {
+        std::ofstream{path} << "low 0\nhigh " << high << "\nmax 0\noom 0\noom_kill 0\n";
+    }
+
+    bool wait_for_rounds(Pressure::Monitor const& monitor, size_t rounds) {
+        for (int i = 0; i < 500 and monitor.rounds() < rounds; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        return monitor.rounds() >= rounds;
+    }
+}
+
+TEST(Pressure, TrimGivesFreeMemoryBack) {
+    TlsfHeap heap{Backends::Tlsf::Options{.pool_size = size_t{4} << 20}};
+    heap.allocate_constructed_n<char>(size_t{1} << 20);
+    EXPECT_GE(heap.trim(), size_t{3} << 20);
+    Heap segments;
+    EXPECT_EQ(segments.trim(), 0u);
+}
+
+TEST(Pressure, MemoryEventsRunTheReclaimers) {
+    std::string const events = testing::TempDir() + "memory.events";
+    write_events(events, 0);
+    Pressure::Monitor monitor{Pressure::Monitor::Options{
+        .psi = {}, .events = events, .interval = std::chrono::milliseconds{10}, .cooldown = std::chrono::milliseconds{0}}};
+    EXPECT_FALSE(monitor.psi_active());
+    ASSERT_TRUE(monitor.events_active());
+
+    BasicHeap<Backends::Tlsf, Policies::Locked> heap{Backends::Tlsf::Options{.pool_size = size_t{1} << 20}};
+    std::atomic<int> evictions{0};
+    monitor.watch(heap);
+    size_t const hook = monitor.add([&evictions] { ++evictions; return size_t{0}; });
+    EXPECT_EQ(monitor.rounds(), 0u);
+
+    write_events(events, 1);
+    ASSERT_TRUE(wait_for_rounds(monitor, 1));
+    EXPECT_EQ(evictions, 1);
+
+    // Unchanged counts are no pressure, removed hooks don't run anymore.
+    monitor.remove(hook);
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    EXPECT_EQ(monitor.rounds(), 1u);
+    write_events(events, 2);
+    ASSERT_TRUE(wait_for_rounds(monitor, 2));
+    EXPECT_EQ(evictions, 1);
+    std::remove(events.c_str());
+}
+
+TEST(Pressure, CooldownHoldsBackRepeatedRounds) {
+    std::string const events = testing::TempDir() + "memory.events.cooldown";
+    write_events(events, 0);
+    Pressure::Monitor monitor{Pressure::Monitor::Options{
+        .psi = {}, .events = events, .interval = std::chrono::milliseconds{10}, .cooldown = std::chrono::hours{1}}};
+    write_events(events, 1);
+    ASSERT_TRUE(wait_for_rounds(monitor, 1));
+    write_events(events, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    EXPECT_EQ(monitor.rounds(), 1u);
+    EXPECT_EQ(monitor.reclaim(), 0u);
+    std::remove(events.c_str());
+}
+
+TEST(Pressure, StartsAndStopsOnWhateverTheSystemHas) {
+    // PSI and cgroup v2 may or may not be there, either way the monitor has to come up and shut down cleanly.
+    Pressure::Monitor monitor;
+    BasicHeap<Backends::Slab, Policies::Locked> heap;
+    monitor.watch(heap);
+    EXPECT_EQ(monitor.rounds(), 0u);
+}
+
+namespace {
+    template<typename Heap_>
+    concept Watchable = requires (Pressure::Monitor& monitor, Heap_& heap) { monitor.watch(heap); };
+}
+
+// Trimming from the monitor's thread needs the heap's lock.
+static_assert(Watchable<BasicHeap<Backends::Tlsf, Policies::Locked>>);
+static_assert(not Watchable<TlsfHeap>);
+static_assert(not Watchable<SlabHeap>);
+
+namespace {
+    std::string write_test_file(char const * name, std::string const& contents) {
+        std::string const path = testing::TempDir() + name;
+        std::ofstream{path, std::ios::binary} << contents;
+        return path;
+    }
+
+    // Some bytes that don't repeat at page boundaries, so misplaced reads show.
+    std::string test_contents(size_t size) {
+        std::string contents(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            contents[i] = static_cast<char>(i * 7 + i / 4096);
+        }
+        return contents;
+    }
+}
+
+TEST(Files, UninitializedArraysAreAlignedAsAsked) {
+    Heap segments;
+    BuddyHeap buddy{Backends::Buddy::Options{.region_size = size_t{4} << 20}};
+    TlsfHeap tlsf{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto a = segments.allocate_uninitialized_n<char>(5000, Os::page_size());
+    auto b = buddy.allocate_uninitialized_n<char>(5000, Os::page_size());
+    auto c = tlsf.allocate_uninitialized_n<double>(100, 256);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&*a) % Os::page_size(), 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&*b) % Os::page_size(), 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&*c) % 256, 0u);
+    EXPECT_GT(segments.used_memory(SizeTypes::Byte), 0);
+}
+
+TEST(Files, ReadFileLoadsStraightIntoTheHeap) {
+    std::string const contents = test_contents(3 * 4096 + 123);
+    std::string const path = write_test_file("read_file.bin", contents);
+    Heap heap;
+    for (bool direct : {false, true}) {
+        auto data = heap.read_file(path, Io::ReadOptions{.direct = direct});
+        ASSERT_EQ(data.Error().error_code(), -1) << data.Error().what();
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(&*data) % Os::page_size(), 0u);
+        EXPECT_EQ(std::string(&*data, contents.size()), contents);
+    }
+    // A partial element at the end is left out.
+    TlsfHeap tlsf{Backends::Tlsf::Options{.pool_size = 1 << 20}};
+    auto words = tlsf.read_file<uint32_t>(path);
+    EXPECT_EQ(std::memcmp(&*words, contents.data(), contents.size() / 4 * 4), 0);
+    EXPECT_EQ(words[contents.size() / 4 - 1], *reinterpret_cast<uint32_t const*>(contents.data() + (contents.size() / 4 - 1) * 4));
+    std::remove(path.c_str());
+}
+
+TEST(Files, MissingFilesAreIoErrors) {
+    Heap heap;
+    auto data = heap.read_file(testing::TempDir() + "does_not_exist.bin");
+    EXPECT_EQ(data.Error().error_code(), -6);
+    data.Error().dont_exit();
+    auto mapped = heap.map_file(testing::TempDir() + "does_not_exist.bin");
+    EXPECT_EQ(mapped.Error().error_code(), -6);
+    mapped.Error().dont_exit();
+}
+
+TEST(Files, MappedFilesAreAdoptedCopyOnWrite) {
+    std::string const contents = test_contents(2 * 4096 + 10);
+    std::string const path = write_test_file("map_file.bin", contents);
+    Heap heap;
+    {
+        auto data = heap.map_file(path);
+        ASSERT_EQ(data.Error().error_code(), -1) << data.Error().what();
+        EXPECT_EQ(std::string(&*data, contents.size()), contents);
+        EXPECT_TRUE(heap.owns(&*data));
+        EXPECT_EQ(heap.used_memory(SizeTypes::Byte), contents.size());
+        data[0] = static_cast<char>(~contents[0]);
+    }
+    EXPECT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+    // The write stayed private.
+    Io::MappedFile const file{path};
+    ASSERT_TRUE(file);
+    EXPECT_EQ(std::string(reinterpret_cast<char const*>(file.data()), file.size()), contents);
+    EXPECT_EQ(file.as<uint16_t>().size(), contents.size() / 2);
+    std::remove(path.c_str());
+}
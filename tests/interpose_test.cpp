@@ -0,0 +1,160 @@
+#include "AutomaticMemory/Interpose.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef PASSIVEGC_MALLOC_LIBRARY
+#include <dlfcn.h>
+#endif
+
+using namespace AutomaticMemory;
+
+TEST(Interposer, AllocateAndFreeRoundTrip) {
+    std::vector<void*> blocks;
+    for (size_t size : {1u, 16u, 100u, 4096u, 40000u, 1u << 20}) {
+        void * memory = Interposer::allocate(size);
+        ASSERT_NE(memory, nullptr);
+        EXPECT_TRUE(Interposer::owns(memory));
+        EXPECT_GE(Interposer::usable_size(memory), size);
+        std::memset(memory, 0xab, size);
+        blocks.push_back(memory);
+    }
+    for (void * block : blocks) {
+        Interposer::free(block);
+    }
+    Interposer::free(nullptr);
+}
+
+TEST(Interposer, AllocateZeroedClearsRecycledMemory) {
+    void * dirty = Interposer::allocate(256);
+    std::memset(dirty, 0xff, 256);
+    Interposer::free(dirty);
+    auto * zeroed = static_cast<unsigned char*>(Interposer::allocate_zeroed(16, 16));
+    ASSERT_NE(zeroed, nullptr);
+    for (size_t i = 0; i < 256; ++i) {
+        EXPECT_EQ(zeroed[i], 0);
+    }
+    Interposer::free(zeroed);
+    EXPECT_EQ(Interposer::allocate_zeroed(SIZE_MAX / 2, 4), nullptr);
+}
+
+TEST(Interposer, ReallocateKeepsContents) {
+    auto * memory = static_cast<unsigned char*>(Interposer::allocate(24));
+    std::memset(memory, 7, 24);
+    // Still fits the size class, stays where it is.
+    EXPECT_EQ(Interposer::reallocate(memory, Interposer::usable_size(memory)), memory);
+    auto * moved = static_cast<unsigned char*>(Interposer::reallocate(memory, 100000));
+    ASSERT_NE(moved, nullptr);
+    for (size_t i = 0; i < 24; ++i) {
+        EXPECT_EQ(moved[i], 7);
+    }
+    EXPECT_EQ(Interposer::reallocate(moved, 0), nullptr);
+}
+
+TEST(Interposer, ReallocateHandsForeignMemoryOn) {
+    auto * foreign = static_cast<char*>(std::malloc(16));
+    std::strcpy(foreign, "foreign");
+    EXPECT_EQ(Interposer::reallocate(foreign, 1000), nullptr);
+    auto * moved = static_cast<char*>(Interposer::reallocate(foreign, 1000, [](void * memory, size_t size) { return std::realloc(memory, size); }));
+    ASSERT_NE(moved, nullptr);
+    EXPECT_FALSE(Interposer::owns(moved));
+    EXPECT_STREQ(moved, "foreign");
+    std::free(moved);
+}
+
+#ifdef PASSIVEGC_MALLOC_LIBRARY
+TEST(Preload, ReallocForwardsForeignMemoryToTheNextRealloc) {
+    // Loaded locally, so it doesn't replace anything in this process and std::malloc memory is foreign to it.
+    void * library = ::dlopen(PASSIVEGC_MALLOC_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+    ASSERT_NE(library, nullptr) << ::dlerror();
+    auto const preload_realloc = reinterpret_cast<void * (*)(void *, size_t)>(::dlsym(library, "realloc"));
+    ASSERT_NE(preload_realloc, nullptr);
+    auto * foreign = static_cast<char*>(std::malloc(16));
+    std::strcpy(foreign, "foreign");
+    auto * moved = static_cast<char*>(preload_realloc(foreign, 1 << 20));
+    ASSERT_NE(moved, nullptr);
+    EXPECT_STREQ(moved, "foreign");
+    std::free(moved);
+}
+#endif
+
+TEST(Interposer, AlignedAllocations) {
+    for (size_t alignment : {16u, 64u, 4096u, 1u << 16}) {
+        void * memory = Interposer::allocate_aligned(1000, alignment);
+        ASSERT_NE(memory, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(memory) % alignment, 0u);
+        Interposer::free(memory);
+    }
+}
+
+TEST(Interposer, SizedFreesPutBlocksBack) {
+    void * small = Interposer::allocate(24);
+    Interposer::free_sized(small, 24);
+    EXPECT_EQ(Interposer::allocate(24), small);
+    // A size that doesn't match the block's class still frees it, through the unsized path.
+    Interposer::free_sized(small, 4000);
+    EXPECT_EQ(Interposer::allocate(24), small);
+    Interposer::free_sized(small, 1 << 20);
+    EXPECT_EQ(Interposer::allocate(24), small);
+    Interposer::free(small);
+
+    // Over the default alignment the block can sit in a bigger class than its size says.
+    void * aligned = Interposer::allocate_aligned(40, 64);
+    Interposer::free_sized(aligned, 40);
+    EXPECT_EQ(Interposer::allocate_aligned(40, 64), aligned);
+    Interposer::free(aligned);
+
+    void * large = Interposer::allocate(100000);
+    Interposer::free_sized(large, 100000);
+    EXPECT_EQ(Interposer::allocate(100000), large);
+    Interposer::free(large);
+
+    int local = 0;
+    Interposer::free_sized(&local, sizeof(local));
+    Interposer::free_sized(&local, 1 << 20);
+    Interposer::free_sized(nullptr, 16);
+}
+
+TEST(Interposer, IgnoresForeignMemory) {
+    int local = 0;
+    EXPECT_FALSE(Interposer::owns(&local));
+    EXPECT_EQ(Interposer::usable_size(&local), 0u);
+    Interposer::free(&local);
+}
+
+TEST(Interposer, ForkWhileOtherThreadsAllocate) {
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&stop] {
+            while (not stop.load(std::memory_order_relaxed)) {
+                Interposer::free(Interposer::allocate(100));
+            }
+        });
+    }
+    for (int round = 0; round < 200; ++round) {
+        pid_t const child = ::fork();
+        ASSERT_GE(child, 0);
+        if (child == 0) {
+            // A heap lock that stayed taken in the child hangs right here, the alarm turns that into a failure.
+            ::alarm(10);
+            Interposer::free(Interposer::allocate(100));
+            ::_exit(0);
+        }
+        int status = 0;
+        ASSERT_EQ(::waitpid(child, &status, 0), child);
+        ASSERT_TRUE(WIFEXITED(status)) << "child died of signal " << WTERMSIG(status) << " in round " << round;
+    }
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,49 @@
+#include "AutomaticMemory/SizeClasses.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace AutomaticMemory;
+
+namespace {
+    template<typename Table_>
+    void expect_waste_bound(Table_) {
+        size_t const waste = Table_::params.max_waste_percent;
+        for (size_t size = 1; size <= Table_::params.max_size; ++size) {
+            size_t const index = Table_::index(size);
+            size_t const class_size = Table_::classes[index].size;
+            size_t const previous = index == 0 ? 0 : Table_::classes[index - 1].size;
+            ASSERT_GE(class_size, size);
+            ASSERT_EQ(class_size % Table_::params.alignment, 0u);
+            // Classes one alignment step apart can't be any finer, the bound only holds for wider steps.
+            if (class_size - previous > Table_::params.alignment) {
+                ASSERT_LE((class_size - size) * 100, class_size * waste) << "size " << size;
+            }
+        }
+    }
+}
+
+TEST(SizeClasses, DefaultTableRespectsWasteBound) {
+    expect_waste_bound(DefaultSizeClasses{});
+}
+
+TEST(SizeClasses, TunedTablesRespectWasteBound) {
+    expect_waste_bound(SizeClassTable<SizeClassParams{.max_waste_percent = 6}>{});
+    expect_waste_bound(SizeClassTable<SizeClassParams{.alignment = 8, .max_size = 4096, .max_waste_percent = 25}>{});
+}
+
+TEST(SizeClasses, RunsHoldTheirObjects) {
+    for (SizeClass const& c : DefaultSizeClasses::classes) {
+        EXPECT_GE(c.objects, 1u);
+        EXPECT_LE(size_t{c.objects} * c.size, size_t{c.run_pages} * DefaultSizeClasses::params.page_size);
+    }
+}
+
+TEST(SizeClasses, LookupIsExactAtClassBoundaries) {
+    for (size_t i = 0; i < DefaultSizeClasses::count; ++i) {
+        size_t const size = DefaultSizeClasses::classes[i].size;
+        EXPECT_EQ(DefaultSizeClasses::index(size), i);
+        if (i + 1 < DefaultSizeClasses::count) {
+            EXPECT_EQ(DefaultSizeClasses::index(size + 1), i + 1);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#include "bench/Statistics.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace Bench::Statistics;
+
+TEST(Statistics, SeparatedSmallSidesUseTheExactDistribution) {
+    // Every after beats every before: U is m * n, and only 1 of the C(10, 5) = 252 orderings does that
+    // each way, so p = 2 / 252.
+    Comparison const result = mann_whitney({1, 2, 3, 4, 5}, {6, 7, 8, 9, 10});
+    EXPECT_TRUE(result.exact);
+    EXPECT_EQ(result.u, 25);
+    EXPECT_NEAR(result.p, 0.0079, 1e-4);
+    EXPECT_DOUBLE_EQ(result.p, 2.0 / 252);
+}
+
+TEST(Statistics, ShiftIntervalComesFromTheExactTails) {
+    /*
+        The 25 differences are 1 to 9, appearing 1, 2, 3, 4, 5, 4, 3, 2, 1 times, so the median is 5. The
+        lower tail of U holds 1, 1, 2, 3 orderings out of 252 for U = 0 to 3, and P(U <= 2) = 4 / 252 is
+        the most that stays under 0.025, so k = 3: the 3rd smallest difference (2) and the 3rd biggest (8).
+    */
+    Comparison const result = mann_whitney({1, 2, 3, 4, 5}, {6, 7, 8, 9, 10}, 0.95);
+    EXPECT_DOUBLE_EQ(result.shift, 5);
+    EXPECT_DOUBLE_EQ(result.shift_low, 2);
+    EXPECT_DOUBLE_EQ(result.shift_high, 8);
+}
+
+TEST(Statistics, TiesUseTheCorrectedNormalApproximation) {
+    std::vector<double> before(10, 1.0), after(10, 2.0);
+    before.insert(before.end(), 10, 2.0);
+    after.insert(after.end(), 10, 3.0);
+    /*
+        U = 10 * 20 (the 1s lose to everything) + 10 * 10 (2s against 3s) + 10 * 10 / 2 (2s against 2s) = 350,
+        150 over its mean of 200. The groups of equal values are 10, 20 and 10 long, so the variance is
+        400 / 12 * (41 - (990 + 7980 + 990) / (40 * 39)) = 1153.846, z = (150 - 0.5) / sqrt(1153.846) = 4.40116
+        and p = erfc(z / sqrt(2)) = 1.07673e-5, the same corrections R's wilcox.test makes with exact = FALSE.
+    */
+    Comparison const result = mann_whitney(before, after);
+    EXPECT_FALSE(result.exact);
+    EXPECT_EQ(result.u, 350);
+    EXPECT_NEAR(result.p, 1.07673e-5, 1e-9);
+    EXPECT_DOUBLE_EQ(result.shift, 1);
+}
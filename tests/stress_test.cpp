@@ -0,0 +1,153 @@
+#include "MemManage.hpp"
+#include "AutomaticMemory/Interpose.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    constexpr int threads = 4;
+    constexpr int operations = 20000;
+
+    /*
+        Every thread churns its own set of arrays and hands some of them to a shared pool that
+        any thread may free, so frees race with allocations from other threads. Every array is
+        filled with a value derived from its size and checked before it dies.
+    */
+    template<typename Heap_, typename Size_>
+    void stress(Heap_& heap, Size_ next_size) {
+        using Array = typename Heap_::template Pointer<unsigned char, true>;
+        std::mutex shared_lock;
+        std::vector<std::optional<Array>> shared;
+        std::atomic<bool> corrupted{false};
+
+        auto const intact = [](Array& array, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                if (array[i] != static_cast<unsigned char>(size)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        auto const worker = [&](unsigned seed) {
+            std::mt19937 rng{seed};
+            std::vector<std::optional<Array>> live;
+            std::vector<size_t> sizes;
+            for (int i = 0; i < operations; ++i) {
+                unsigned const action = rng() % 8;
+                if (live.empty() or action < 4) {
+                    size_t const size = next_size(rng);
+                    Array array = heap.template allocate_constructed_n<unsigned char>(size, static_cast<unsigned char>(size));
+                    if (rng() % 8 == 0) {
+                        std::lock_guard<std::mutex> lock{shared_lock};
+                        shared.emplace_back(std::move(array));
+                    } else {
+                        live.emplace_back(std::move(array));
+                        sizes.push_back(size);
+                    }
+                } else if (action < 7) {
+                    size_t const index = rng() % live.size();
+                    if (not intact(*live[index], sizes[index])) {
+                        corrupted = true;
+                    }
+                    // Pointers can't be move assigned, so swap the last one in through the optionals.
+                    live[index].reset();
+                    if (index + 1 != live.size()) {
+                        live[index].emplace(std::move(*live.back()));
+                    }
+                    live.pop_back();
+                    sizes[index] = sizes.back();
+                    sizes.pop_back();
+                } else {
+                    std::lock_guard<std::mutex> lock{shared_lock};
+                    if (not shared.empty()) {
+                        shared.pop_back();
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back(worker, 17 + t);
+        }
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+        shared.clear();
+        EXPECT_FALSE(corrupted);
+        EXPECT_FLOAT_EQ(heap.used_memory(SizeTypes::Byte), 0);
+    }
+
+    auto mixed_size = [](std::mt19937& rng) -> size_t {
+        return rng() % 16 == 0 ? 4096 + rng() % 60000 : 1 + rng() % 300;
+    };
+}
+
+TEST(Stress, LockedSegmentsHeap) {
+    BasicHeap<Backends::Segments, Policies::Locked> heap;
+    stress(heap, mixed_size);
+}
+
+TEST(Stress, LockedTlsfHeap) {
+    BasicHeap<Backends::Tlsf, Policies::Locked> heap{Backends::Tlsf::Options{.pool_size = size_t{16} << 20, .grow = true}};
+    stress(heap, mixed_size);
+}
+
+TEST(Stress, LockedSlabHeap) {
+    BasicHeap<Backends::Slab, Policies::Locked> heap;
+    stress(heap, mixed_size);
+}
+
+TEST(Stress, LockedBuddyHeap) {
+    BasicHeap<Backends::Buddy, Policies::Locked> heap{Backends::Buddy::Options{.min_block = 4096, .max_block = 1 << 20, .region_size = size_t{1} << 30}};
+    stress(heap, [](std::mt19937& rng) -> size_t { return size_t{4096} << (rng() % 5); });
+}
+
+TEST(Stress, InterposerFromManyThreads) {
+    std::atomic<bool> corrupted{false};
+    auto const worker = [&](unsigned seed) {
+        std::mt19937 rng{seed};
+        std::vector<std::pair<unsigned char*, size_t>> live;
+        for (int i = 0; i < operations; ++i) {
+            if (live.empty() or rng() % 2) {
+                size_t const size = mixed_size(rng);
+                auto * memory = static_cast<unsigned char*>(Interposer::allocate(size));
+                std::memset(memory, static_cast<int>(size & 0xff), size);
+                live.emplace_back(memory, size);
+            } else {
+                size_t const index = rng() % live.size();
+                auto const [memory, size] = live[index];
+                for (size_t b = 0; b < size; ++b) {
+                    if (memory[b] != static_cast<unsigned char>(size & 0xff)) {
+                        corrupted = true;
+                        break;
+                    }
+                }
+                Interposer::free(memory);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        for (auto const& [memory, size] : live) {
+            Interposer::free(memory);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker, 41 + t);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    EXPECT_FALSE(corrupted);
+}
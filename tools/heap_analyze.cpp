@@ -0,0 +1,149 @@
+/*
+    Reports on a heap dump written by BasicHeap::dump().
+
+    Top consumers: sampled blocks grouped by what they were allocated as and where, biggest first.
+    Frames are raw return addresses of the dumped process, feed them to addr2line -f -C -e <binary>
+    (minus the load address for position independent executables). Blocks that weren't sampled are
+    grouped by size instead.
+
+    Fragmentation map: one row per span, every character is a slice of it, by how much of the slice
+    is live: ' ' none, '.' under a quarter, ':' under half, '+' under three quarters, '#' the rest.
+    Next to it the free bytes and how much of them the biggest gap is, a span whose free memory is
+    scattered in small gaps can't serve a big request even though it looks empty enough.
+
+    Usage: heap_analyze dump.txt [--top N] [--width columns]
+*/
+#include "AutomaticMemory/Walk.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    struct Consumer {
+        std::string what;
+        std::vector<uintptr_t> frames;
+        size_t bytes = 0;
+        size_t blocks = 0;
+    };
+
+    char const * kind_name(Accounting::Kind kind) {
+        switch (kind) {
+            case Accounting::Kind::Type: return "type";
+            case Accounting::Kind::Tag: return "tag";
+            default: return "untagged";
+        }
+    }
+
+    void print_consumers(std::vector<Walk::DumpedSpan> const& spans, size_t top) {
+        std::map<std::tuple<int, std::string, std::vector<uintptr_t>>, Consumer> sampled;
+        std::map<size_t, Consumer> by_size;
+        for (Walk::DumpedSpan const& span : spans) {
+            for (Walk::DumpedBlock const& block : span.blocks) {
+                Consumer* consumer;
+                if (block.sampled) {
+                    consumer = &sampled[{static_cast<int>(block.kind), block.name, block.frames}];
+                    consumer->what = std::string{kind_name(block.kind)} + " " + block.name;
+                    consumer->frames = block.frames;
+                } else {
+                    consumer = &by_size[block.size];
+                    consumer->what = "unsampled, " + std::to_string(block.size) + " byte blocks";
+                }
+                consumer->bytes += block.size;
+                ++consumer->blocks;
+            }
+        }
+        auto const print = [top](char const* title, auto const& groups) {
+            std::vector<Consumer const*> sorted;
+            for (auto const& [key, consumer] : groups) {
+                sorted.push_back(&consumer);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](Consumer const* left, Consumer const* right) {
+                return left->bytes > right->bytes;
+            });
+            std::printf("%s\n", title);
+            for (size_t i = 0; i < sorted.size() and i < top; ++i) {
+                std::printf("  %12zu bytes %8zu blocks  %s\n", sorted[i]->bytes, sorted[i]->blocks, sorted[i]->what.c_str());
+                for (uintptr_t frame : sorted[i]->frames) {
+                    std::printf("      %#zx\n", static_cast<size_t>(frame));
+                }
+            }
+        };
+        print("Top sampled consumers:", sampled);
+        print("Top unsampled block sizes:", by_size);
+    }
+
+    void print_map(std::vector<Walk::DumpedSpan> const& spans, size_t width) {
+        size_t reserved = 0, live = 0, blocks = 0;
+        std::printf("Fragmentation map:\n");
+        for (Walk::DumpedSpan const& span : spans) {
+            std::vector<size_t> used(width);
+            size_t span_live = 0, largest_gap = 0;
+            uintptr_t cursor = span.base;
+            for (Walk::DumpedBlock const& block : span.blocks) {
+                largest_gap = std::max<size_t>(largest_gap, block.address > cursor ? block.address - cursor : 0);
+                cursor = std::max<uintptr_t>(cursor, block.address + block.size);
+                span_live += block.size;
+                // Spread the block over the columns it covers.
+                for (uintptr_t at = block.address; at < block.address + block.size;) {
+                    size_t const column = std::min(width - 1, static_cast<size_t>((at - span.base) * width / span.size));
+                    uintptr_t const column_end = span.base + (column + 1) * span.size / width;
+                    uintptr_t const end = std::min<uintptr_t>(std::max(column_end, at + 1), block.address + block.size);
+                    used[column] += end - at;
+                    at = end;
+                }
+            }
+            largest_gap = std::max<size_t>(largest_gap, span.base + span.size > cursor ? span.base + span.size - cursor : 0);
+            std::string row(width, ' ');
+            for (size_t column = 0; column < width; ++column) {
+                size_t const slice = std::max<size_t>(1, span.size / width);
+                double const fill = static_cast<double>(used[column]) / slice;
+                row[column] = fill == 0 ? ' ' : fill < 0.25 ? '.' : fill < 0.5 ? ':' : fill < 0.75 ? '+' : '#';
+            }
+            size_t const free = span.size > span_live ? span.size - span_live : 0;
+            std::printf("  %#14zx %10zu |%s| free %10zu, biggest gap %5.1f%%\n", static_cast<size_t>(span.base), span.size,
+                row.c_str(), free, free > 0 ? 100.0 * largest_gap / free : 100.0);
+            reserved += span.size;
+            live += span_live;
+            blocks += span.blocks.size();
+        }
+        std::printf("%zu spans, %zu bytes, %zu live blocks, %zu live bytes (%.1f%%)\n", spans.size(), reserved, blocks, live,
+            reserved > 0 ? 100.0 * live / reserved : 0.0);
+    }
+}
+
+auto main(int argc, char** argv) -> int {
+    char const* path = nullptr;
+    size_t top = 10;
+    size_t width = 64;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--top") == 0 and i + 1 < argc) {
+            top = std::stoul(argv[++i]);
+        } else if (std::strcmp(argv[i], "--width") == 0 and i + 1 < argc) {
+            width = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr) {
+        std::fprintf(stderr, "Usage: %s dump.txt [--top N] [--width columns]\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream file{path};
+    auto const spans = Walk::read_dump(file);
+    if (not spans) {
+        std::fprintf(stderr, "%s isn't a heap dump\n", path);
+        return 1;
+    }
+    print_consumers(*spans, top);
+    print_map(*spans, width);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+    Prints the expected waste of size class tables for a recorded size distribution.
+
+    The input is a text file (or stdin) with one allocation per line, either "size" or
+    "size count". Every candidate table below is evaluated against it. To tune for a
+    workload, add a candidate with different SizeClassParams, compare, then use the
+    winner in BasicSlab<SizeClassTable<...>>.
+
+    Build: g++ -std=c++20 -O2 -I. tools/size_class_waste.cpp -o size_class_waste
+    Usage: size_class_waste [sizes.txt] [--classes]
+*/
+#include "AutomaticMemory/SizeClasses.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace AutomaticMemory;
+
+namespace {
+    struct Sample {
+        size_t size;
+        size_t count;
+    };
+
+    std::vector<Sample> read_samples(std::istream& input) {
+        std::vector<Sample> samples;
+        std::string line;
+        while (std::getline(input, line)) {
+            std::istringstream fields{line};
+            Sample sample{0, 1};
+            if (fields >> sample.size) {
+                fields >> sample.count;
+                samples.push_back(sample);
+            }
+        }
+        return samples;
+    }
+
+    template<typename Table_>
+    void evaluate(char const* name, std::vector<Sample> const& samples, bool print_classes) {
+        std::vector<size_t> requested(Table_::count), allocated(Table_::count), objects(Table_::count);
+        size_t oversized = 0;
+        for (Sample const& sample : samples) {
+            if (sample.size > Table_::params.max_size) {
+                oversized += sample.count;
+                continue;
+            }
+            size_t const index = Table_::index(sample.size);
+            requested[index] += sample.size * sample.count;
+            allocated[index] += Table_::classes[index].size * sample.count;
+            objects[index] += sample.count;
+        }
+
+        size_t total_requested = 0, total_allocated = 0;
+        double run_waste = 0;
+        for (size_t i = 0; i < Table_::count; ++i) {
+            total_requested += requested[i];
+            total_allocated += allocated[i];
+            SizeClass const& c = Table_::classes[i];
+            size_t const run = c.run_pages * Table_::params.page_size;
+            // Tail of every run that can't hold another object, spread over the bytes allocated in the class.
+            run_waste += allocated[i] * static_cast<double>(run - c.objects * c.size) / (c.objects * c.size);
+        }
+        double const internal = total_allocated ? 100.0 * (total_allocated - total_requested) / total_allocated : 0;
+        double const tail = total_allocated ? 100.0 * run_waste / (total_allocated + run_waste) : 0;
+        std::printf("%-22s classes %3zu  requested %12zu  allocated %12zu  internal %6.2f%%  run tail %5.2f%%  oversized %zu\n",
+            name, Table_::count, total_requested, total_allocated, internal, tail, oversized);
+
+        if (print_classes) {
+            std::printf("  %8s %6s %8s %12s %8s\n", "class", "pages", "objects", "requests", "waste");
+            for (size_t i = 0; i < Table_::count; ++i) {
+                if (objects[i] == 0) {
+                    continue;
+                }
+                SizeClass const& c = Table_::classes[i];
+                std::printf("  %8u %6u %8u %12zu %7.2f%%\n", c.size, c.run_pages, c.objects, objects[i],
+                    100.0 * (allocated[i] - requested[i]) / allocated[i]);
+            }
+        }
+    }
+}
+
+auto main(int argc, char** argv) -> int {
+    bool print_classes = false;
+    char const* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--classes") == 0) {
+            print_classes = true;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    std::vector<Sample> samples;
+    if (path != nullptr) {
+        std::ifstream file{path};
+        if (not file) {
+            std::fprintf(stderr, "Couldn't open %s\n", path);
+            return 1;
+        }
+        samples = read_samples(file);
+    } else {
+        samples = read_samples(std::cin);
+    }
+
+    evaluate<DefaultSizeClasses>("default (12%)", samples, print_classes);
+    evaluate<SizeClassTable<SizeClassParams{.max_waste_percent = 6}>>("waste 6%", samples, print_classes);
+    evaluate<SizeClassTable<SizeClassParams{.max_waste_percent = 25}>>("waste 25%", samples, print_classes);
+    evaluate<SizeClassTable<SizeClassParams{.alignment = 8, .max_waste_percent = 12}>>("align 8, waste 12%", samples, print_classes);
+    evaluate<SizeClassTable<SizeClassParams{.max_size = size_t{256} << 10, .max_waste_percent = 12, .max_run_pages = 128}>>("up to 256 KiB", samples, print_classes);
+    return 0;
+}